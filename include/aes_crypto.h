@@ -0,0 +1,161 @@
+/**
+ * \file aes_crypto.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_AES_CRYPTO_H
+#define INTERFACE_CPPZIP_AES_CRYPTO_H
+
+#include <array>
+#include <batch_reader.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct evp_cipher_ctx_st;
+struct evp_md_ctx_st;
+struct evp_pkey_st;
+
+namespace cppzip
+{
+  namespace detail
+  {
+    constexpr uint16_t aes_extra_field_id = 0x9901;
+    constexpr uint16_t aes_compression_method = 99;
+    constexpr size_t aes_verifier_size = 2;
+    constexpr size_t aes_mac_size = 10;
+
+    /**
+     * The content of the WinZip AES extra field. strength is 1, 2 or 3 for 128, 192 or 256 bit
+     * keys, method is the compression method of the payload.
+     */
+    struct AesField
+    {
+      uint16_t version;
+      uint8_t strength;
+      uint16_t method;
+    };
+
+    /**
+     * Looks for the AES record in an extra field. Returns false if there is none.
+     */
+    bool findAesField(const std::vector<uint8_t>& extra, AesField& field);
+
+    /**
+     * Returns the AES record including its id and size.
+     */
+    auto makeAesField(const AesField& field) -> std::vector<uint8_t>;
+
+    constexpr auto aesSaltSize(uint8_t strength) -> size_t
+    {
+      return 4 * (strength + 1u);
+    }
+
+    constexpr auto aesKeySize(uint8_t strength) -> size_t
+    {
+      return 8 * (strength + 1u);
+    }
+
+    /**
+     * The bytes an encrypted payload has on top of the encrypted data: the salt and the password
+     * verifier in front, the authentication code behind.
+     */
+    constexpr auto aesOverhead(uint8_t strength) -> size_t
+    {
+      return aesSaltSize(strength) + aes_verifier_size + aes_mac_size;
+    }
+
+    /**
+     * The keys PBKDF2 derives from the password and the salt of an entry.
+     */
+    struct AesKeys
+    {
+      uint8_t strength;
+      std::vector<uint8_t> cipher;
+      std::vector<uint8_t> mac;
+      std::array<uint8_t, aes_verifier_size> verifier;
+    };
+
+    auto deriveAesKeys(const std::string& password, const uint8_t* salt, uint8_t strength) -> AesKeys;
+
+    /**
+     * AES in the counter mode of WinZip, whose counter is little endian and starts at 1. Positions
+     * are relative to the start of the encrypted data, so any range can be processed on its own.
+     * The key stream is produced for many blocks per call, which lets OpenSSL pipeline AES-NI and
+     * VAES instructions where the CPU has them.
+     */
+    class AesCtr final
+    {
+    public:
+      explicit AesCtr(const AesKeys& keys);
+      ~AesCtr();
+      AesCtr(const AesCtr&) = delete;
+      AesCtr& operator=(const AesCtr&) = delete;
+
+      void crypt(uint64_t position, uint8_t* data, size_t length);
+
+    private:
+      evp_cipher_ctx_st* m_ctx;
+    };
+
+    /**
+     * HMAC-SHA1 over the encrypted data, truncated to the 10 bytes stored behind it.
+     */
+    class AesMac final
+    {
+    public:
+      explicit AesMac(const AesKeys& keys);
+      ~AesMac();
+      AesMac(const AesMac&) = delete;
+      AesMac& operator=(const AesMac&) = delete;
+
+      void update(const uint8_t* data, size_t length);
+      auto finish() -> std::array<uint8_t, aes_mac_size>;
+
+    private:
+      evp_pkey_st* m_key;
+      evp_md_ctx_st* m_ctx;
+    };
+
+    /**
+     * Reads the encrypted data of a payload and decrypts each chunk in the buffer it was read
+     * into, so inflating it touches every byte once. Reads in order are authenticated as well.
+     */
+    class AesReader final
+    {
+    public:
+      AesReader(ReadAt_fn read, const AesKeys& keys, uint64_t offset, uint64_t length);
+
+      auto read(uint64_t position, uint8_t* buffer, size_t length) -> size_t;
+
+      /**
+       * Returns true if all the encrypted data was read in order and matches the code.
+       */
+      bool authentic(const uint8_t* mac);
+
+    private:
+      ReadAt_fn m_read;
+      AesCtr m_ctr;
+      AesMac m_mac;
+      uint64_t m_offset;
+      uint64_t m_length;
+      uint64_t m_authenticated = 0;
+    };
+
+    /**
+     * Encrypts a payload with a random salt and returns the salt, the password verifier, the
+     * encrypted data and the authentication code.
+     */
+    auto aesEncrypt(const std::string& password, uint8_t strength, const std::vector<uint8_t>& payload)
+        -> std::vector<uint8_t>;
+
+    /**
+     * Decrypts and authenticates a complete payload as produced by aesEncrypt.
+     */
+    auto aesDecrypt(const AesKeys& keys, const uint8_t* payload, size_t length) -> std::vector<uint8_t>;
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_AES_CRYPTO_H */
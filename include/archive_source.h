@@ -0,0 +1,51 @@
+/**
+ * \file archive_source.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_ARCHIVE_SOURCE_H
+#define INTERFACE_CPPZIP_ARCHIVE_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    /**
+     * The storage an archive is read from. The implementations are final, so the directory
+     * parser which is instantiated for each of them calls them directly. Entries share the
+     * source of their archive through this base.
+     */
+    class ArchiveSource
+    {
+    public:
+      virtual ~ArchiveSource() = default;
+
+      /**
+       * Reads up to length bytes at offset. Returns less only at the end of the archive.
+       */
+      virtual auto readAt(uint64_t offset, uint8_t* buffer, size_t length) const -> size_t = 0;
+
+      virtual auto size() const -> uint64_t = 0;
+
+      /**
+       * The file descriptor for kernel copies and batched reads, -1 if there is none.
+       */
+      virtual int nativeHandle() const noexcept = 0;
+
+      /**
+       * The contiguous bytes of the archive, nullptr if it is not held in memory.
+       */
+      virtual auto data() const noexcept -> const uint8_t* = 0;
+    };
+
+    using ArchiveSourcePtr = std::shared_ptr<const ArchiveSource>;
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_ARCHIVE_SOURCE_H */
@@ -0,0 +1,65 @@
+/**
+ * \file async_context.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_ASYNC_CONTEXT_H
+#define INTERFACE_CPPZIP_ASYNC_CONTEXT_H
+
+#include <cppzip/v1/executor.h>
+#include <memory>
+#include <mutex>
+#include <thread_pool.h>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    /**
+     * Dispatches the asynchronous work of an archive. Uses the executor set by the caller
+     * or a pool owned by the archive which is created on first use.
+     */
+    class AsyncContext final
+    {
+    public:
+      void setExecutor(Executor executor)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_executor = std::move(executor);
+      }
+
+      void post(std::function<void()> job)
+      {
+        Executor executor;
+        std::shared_ptr<ThreadPool> pool;
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          if (!m_executor && !m_pool)
+          {
+            m_pool = std::make_shared<ThreadPool>();
+          }
+          executor = m_executor;
+          pool = m_pool;
+        }
+        if (executor)
+        {
+          executor(std::move(job));
+        }
+        else
+        {
+          // The job keeps the pool alive, it may drop the last reference to the archive.
+          pool->post([pool, job = std::move(job)] { job(); });
+        }
+      }
+
+    private:
+      std::mutex m_mutex;
+      Executor m_executor;
+      std::shared_ptr<ThreadPool> m_pool;
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_ASYNC_CONTEXT_H */
@@ -0,0 +1,59 @@
+/**
+ * \file batch_reader.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_BATCH_READER_H
+#define INTERFACE_CPPZIP_BATCH_READER_H
+
+#include <cppzip/v1/zip_archive.h>
+#include <functional>
+#include <vector>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    /**
+     * Positional read used by the batch reader. Returns the number of bytes read.
+     */
+    using ReadAt_fn = std::function<size_t(uint64_t, uint8_t*, size_t)>;
+
+    /**
+     * The storage of an archive as seen by the batch reader. fd is -1 when the
+     * archive is not backed by a file descriptor (in memory or non POSIX).
+     */
+    struct ReadSource
+    {
+      int fd;
+      ReadAt_fn read_at;
+    };
+
+    struct BatchItem
+    {
+      uint64_t offset;
+      size_t length;
+    };
+
+    /**
+     * Called on a worker thread with the index of the item and its raw bytes.
+     */
+    using BatchConsumer = std::function<void(size_t, std::vector<uint8_t>&)>;
+
+    /**
+     * Reads all items and hands each of them to consumer on a worker pool. Reads are
+     * submitted in batches of up to options.queue_depth through io_uring when it is
+     * available and requested, otherwise the workers issue positional reads themselves.
+     * The first exception thrown by a read or the consumer is rethrown once all
+     * outstanding work has finished.
+     */
+    void readBatch(const ReadSource& source,
+                   const std::vector<BatchItem>& items,
+                   const BulkReadOptions& options,
+                   const BatchConsumer& consumer);
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_BATCH_READER_H */
@@ -0,0 +1,74 @@
+/**
+ * \file cached_source.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_CACHED_SOURCE_H
+#define INTERFACE_CPPZIP_CACHED_SOURCE_H
+
+#include <archive_source.h>
+#include <condition_variable>
+#include <cppzip/v1/random_access_source.h>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    /**
+     * Puts a block cache with adaptive readahead in front of a RandomAccessSource. Adjacent
+     * missing blocks are fetched with one read, and a block another thread is already fetching
+     * is waited for instead of being read again.
+     */
+    class CachedSource final : public ArchiveSource
+    {
+    public:
+      CachedSource(std::shared_ptr<const RandomAccessSource> source, const SourceCacheOptions& options);
+
+      auto readAt(uint64_t offset, uint8_t* buffer, size_t length) const -> size_t override;
+      auto size() const -> uint64_t override;
+      int nativeHandle() const noexcept override;
+      auto data() const noexcept -> const uint8_t* override;
+
+    private:
+      struct Block
+      {
+        std::vector<uint8_t> data;
+        bool ready = false;
+        std::exception_ptr error;
+        std::list<uint64_t>::iterator lru;
+      };
+      using BlockPtr = std::shared_ptr<Block>;
+
+      /**
+       * Blocks [first, first + blocks.size()) which are fetched with one read.
+       */
+      struct Run
+      {
+        uint64_t first;
+        std::vector<BlockPtr> blocks;
+      };
+
+      void fetch(const Run& run) const;
+      void evict() const;
+
+      const std::shared_ptr<const RandomAccessSource> m_source;
+      const SourceCacheOptions m_options;
+      const uint64_t m_size;
+      mutable std::mutex m_mutex;
+      mutable std::condition_variable m_fetched;
+      mutable std::unordered_map<uint64_t, BlockPtr> m_blocks;
+      mutable std::list<uint64_t> m_lru;
+      mutable uint64_t m_next_offset = 0;
+      mutable size_t m_readahead = 0;
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_CACHED_SOURCE_H */
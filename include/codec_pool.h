@@ -0,0 +1,84 @@
+/**
+ * \file codec_pool.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_CODEC_POOL_H
+#define INTERFACE_CPPZIP_CODEC_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <zlib.h>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    /**
+     * A raw deflate stream which is reset instead of being torn down between entries.
+     */
+    struct Deflater final
+    {
+      explicit Deflater(int level);
+      ~Deflater();
+      Deflater(const Deflater&) = delete;
+      Deflater& operator=(const Deflater&) = delete;
+
+      z_stream strm;
+      int level;
+    };
+
+    /**
+     * A raw inflate stream which is reset instead of being torn down between entries.
+     */
+    struct Inflater final
+    {
+      Inflater();
+      ~Inflater();
+      Inflater(const Inflater&) = delete;
+      Inflater& operator=(const Inflater&) = delete;
+
+      z_stream strm;
+    };
+
+    /**
+     * Hands the stream back to the pool of the releasing thread.
+     */
+    struct CodecRelease
+    {
+      void operator()(Deflater* deflater) const noexcept;
+      void operator()(Inflater* inflater) const noexcept;
+    };
+
+    using DeflaterPtr = std::unique_ptr<Deflater, CodecRelease>;
+    using InflaterPtr = std::unique_ptr<Inflater, CodecRelease>;
+
+    /**
+     * Returns a reset deflate stream with the given level from the pool of the calling
+     * thread, creating one if the pool is empty.
+     */
+    auto acquireDeflater(int level) -> DeflaterPtr;
+
+    /**
+     * Returns a reset inflate stream from the pool of the calling thread.
+     */
+    auto acquireInflater() -> InflaterPtr;
+
+    /**
+     * Compresses the data into one raw deflate stream.
+     */
+    auto deflateRaw(const uint8_t* data, size_t length, int level) -> std::vector<uint8_t>;
+
+    /**
+     * Inflates a complete raw deflate stream. expected_size is the size recorded in the
+     * headers, the output grows beyond it if the stream is longer.
+     */
+    auto inflateRaw(const uint8_t* data, size_t length, size_t expected_size) -> std::vector<uint8_t>;
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_CODEC_POOL_H */
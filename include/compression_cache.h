@@ -0,0 +1,62 @@
+/**
+ * \file compression_cache.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_COMPRESSION_CACHE_H
+#define INTERFACE_CPPZIP_COMPRESSION_CACHE_H
+
+#include <boost/filesystem.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <parallel_deflate.h>
+#include <set>
+#include <string>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    /**
+     * Deflated payloads on disk, named by the SHA-256 of their content and the compression
+     * level. Files are written under a temporary name and renamed into place, so processes
+     * sharing the directory see whole files or none. A hit refreshes the modification time,
+     * and once the directory grows beyond its cap the oldest files are removed.
+     */
+    class CompressionCache final
+    {
+    public:
+      using Deflate_fn = std::function<DeflateResult()>;
+
+      CompressionCache(boost::filesystem::path directory, uint64_t max_size);
+      CompressionCache(const CompressionCache&) = delete;
+      CompressionCache& operator=(const CompressionCache&) = delete;
+
+      /**
+       * Returns the stored payload of the content, or deflates it and stores the result. Callers
+       * with the same content at the same time wait for the first one instead of deflating too.
+       */
+      auto deflate(const uint8_t* data, size_t length, int level, const Deflate_fn& fn) -> DeflateResult;
+
+    private:
+      auto pathOf(const std::string& key) const -> boost::filesystem::path;
+      bool load(const boost::filesystem::path& path, uint64_t length, DeflateResult& result) const;
+      void store(const boost::filesystem::path& path, uint64_t length, const DeflateResult& result);
+      void evict();
+
+      const boost::filesystem::path m_directory;
+      const uint64_t m_max_size;
+      std::mutex m_mutex;
+      std::condition_variable m_stored;
+      std::set<std::string> m_in_flight;
+      uint64_t m_size = 0;
+      bool m_evicting = false;
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_COMPRESSION_CACHE_H */
@@ -0,0 +1,99 @@
+/**
+ * \file file_writer.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_FILE_WRITER_H
+#define INTERFACE_CPPZIP_FILE_WRITER_H
+
+#include <boost/filesystem.hpp>
+#include <cstdint>
+#include <fstream>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    constexpr size_t file_write_chunk_size = 1 << 20;
+    constexpr size_t file_write_alignment = 4096;
+    constexpr size_t file_move_chunk_size = 8 << 20;
+
+    /**
+     * A destination file written with plain system calls, so stored payloads can be copied
+     * by the kernel without passing through user space.
+     */
+    class FileWriter final
+    {
+    public:
+      explicit FileWriter(const boost::filesystem::path& path);
+      ~FileWriter();
+      FileWriter(const FileWriter&) = delete;
+      FileWriter& operator=(const FileWriter&) = delete;
+
+      /**
+       * Reserves size bytes on disk. File systems which can not preallocate are ignored.
+       */
+      void preallocate(uint64_t size);
+
+      /**
+       * Appends length bytes starting at offset of the file descriptor fd, using
+       * copy_file_range or sendfile where available.
+       */
+      void copyFrom(int fd, uint64_t offset, uint64_t length);
+
+      void write(const uint8_t* data, size_t length);
+
+      /**
+       * Flushes and closes the file, reporting errors which a destructor would swallow.
+       */
+      void close();
+
+    private:
+      boost::filesystem::path m_path;
+#if defined(_WIN32)
+      std::ofstream m_file;
+#else
+      int m_fd = -1;
+#endif
+    };
+
+#if !defined(_WIN32)
+    /**
+     * Copies length bytes of the file descriptor fd from offset from to offset to. The ranges
+     * may only overlap if to is the lower one. Uses copy_file_range where available and large
+     * buffered copies otherwise.
+     */
+    void copyRange(int fd, uint64_t from, uint64_t to, uint64_t length);
+#endif
+
+    /**
+     * A heap buffer aligned for direct writes.
+     */
+    class AlignedBuffer final
+    {
+    public:
+      explicit AlignedBuffer(size_t size);
+      ~AlignedBuffer();
+      AlignedBuffer(const AlignedBuffer&) = delete;
+      AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+      auto data() noexcept -> uint8_t*
+      {
+        return m_data;
+      }
+
+      auto size() const noexcept -> size_t
+      {
+        return m_size;
+      }
+
+    private:
+      uint8_t* m_data;
+      size_t m_size;
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_FILE_WRITER_H */
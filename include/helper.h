@@ -8,39 +8,54 @@
 #ifndef INTERFACE_CPPZIP_HELPER_H
 #define INTERFACE_CPPZIP_HELPER_H
 
-#include <boost/endian/conversion.hpp>
 #include <boost/crc.hpp>
-#include <ostream>
+#include <boost/endian/conversion.hpp>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 
 namespace cppzip
 {
   namespace detail
   {
-    struct WriteToStream
+    inline uint32_t getCrc32(const uint8_t* data, size_t length)
+    {
+      boost::crc_32_type result;
+      result.process_bytes(data, length);
+      return result.checksum();
+    }
+
+    /**
+     * Returns size as a header field. Sizes from 0xFFFFFFFF up would need zip64, which is not written.
+     */
+    inline uint32_t checkedSize(uint64_t size)
     {
-      typedef size_t result_type;
+      if (size >= std::numeric_limits<uint32_t>::max())
+      {
+        throw std::runtime_error("Entry is too large");
+      }
+      return static_cast<uint32_t>(size);
+    }
 
-      std::ostream& stream;
-      WriteToStream(std::ostream& s) : stream{s}
+    /**
+     * Reads the little endian fields of a fusion adapted header from a buffer.
+     */
+    struct ReadFromArray final
+    {
+      const uint8_t* buffer;
+      ReadFromArray(const uint8_t* a) noexcept : buffer(a)
       {
       }
       template<typename T>
-      size_t operator()(size_t acc, const T& t) const
+      void operator()(T& t)
       {
-        const size_t before = stream.tellp();
-        T tmp = boost::endian::native_to_little(t);
-        stream.write(reinterpret_cast<const char*>(&tmp), sizeof(T));
-        return acc + stream.tellp() - before;
+        T tmp;
+        memcpy(&tmp, buffer, sizeof(T));
+        t = boost::endian::little_to_native(tmp);
+        buffer += sizeof(T);
       }
     };
 
-    inline uint32_t getCrc32(const uint8_t* data, size_t length)
-    {
-      boost::crc_32_type result;
-      result.process_bytes(data, length);
-      return result.checksum();
-    }
-
   } // namespace detail
 } // namespace cppzip
 
@@ -0,0 +1,74 @@
+/**
+ * \file inflate_index.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_INFLATE_INDEX_H
+#define INTERFACE_CPPZIP_INFLATE_INDEX_H
+
+#include <batch_reader.h>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    constexpr size_t inflate_window_size = 32768;
+
+    /**
+     * A point in a raw deflate stream at which inflation can be restarted, in the style
+     * of zlib's zran example. bits is the number of bits of the byte before in that
+     * belong to the next block.
+     */
+    struct AccessPoint
+    {
+      uint64_t out;
+      uint64_t in;
+      int bits;
+      std::vector<uint8_t> window;
+    };
+
+    /**
+     * The access points of one deflated payload. Reads are relative to the start of the
+     * payload and limited to its compressed size.
+     */
+    class InflateIndex final
+    {
+    public:
+      /**
+       * Inflates the whole payload once and records an access point about every spacing
+       * bytes of output.
+       */
+      static auto build(const ReadAt_fn& read, uint64_t compressed_size, uint64_t spacing) -> InflateIndex;
+
+      /**
+       * Inflates length bytes starting at offset of the output into buffer, starting from
+       * the closest access point. Returns the number of bytes produced.
+       */
+      auto extract(const ReadAt_fn& read, uint64_t offset, uint8_t* buffer, size_t length) const -> size_t;
+
+      void save(std::ostream& out, uint32_t crc32, uint64_t compressed_size) const;
+
+      /**
+       * Loads an index written by save. Returns false if it belongs to another payload or its
+       * access points are not in stream order.
+       */
+      bool load(std::istream& in, uint32_t crc32, uint64_t compressed_size);
+
+      auto size() const noexcept -> size_t
+      {
+        return m_points.size();
+      }
+
+    private:
+      uint64_t m_compressed_size = 0;
+      std::vector<AccessPoint> m_points;
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_INFLATE_INDEX_H */
@@ -31,6 +31,8 @@ namespace cppzip
   };
   constexpr size_t local_file_header_size = 30;
   constexpr size_t local_file_header_signature = 0x4034b50;
+  constexpr size_t data_descriptor_signature = 0x8074b50;
+  constexpr size_t data_descriptor_size = 12;
 } // namespace cppzip
 
 BOOST_FUSION_ADAPT_STRUCT(cppzip::LocalFileHeader,
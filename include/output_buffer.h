@@ -0,0 +1,132 @@
+/**
+ * \file output_buffer.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_OUTPUT_BUFFER_H
+#define INTERFACE_CPPZIP_OUTPUT_BUFFER_H
+
+#include <boost/endian/conversion.hpp>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    constexpr size_t default_output_buffer_size = 1 << 20;
+
+    /**
+     * Collects headers and small payloads in a contiguous scratch buffer and hands them
+     * to the stream in large writes. The number of emitted bytes is tracked here so the
+     * writer never has to ask the stream for its position. Over a block of memory the
+     * bytes are copied to their place right away.
+     */
+    class OutputBuffer final
+    {
+    public:
+      explicit OutputBuffer(std::ostream& s, size_t capacity = default_output_buffer_size)
+        : m_stream(&s), m_target{}, m_capacity{capacity}, m_flushed{}
+      {
+        m_buffer.reserve(m_capacity);
+      }
+
+      OutputBuffer(uint8_t* target, size_t size) : m_stream{}, m_target{target}, m_capacity{size}, m_flushed{}
+      {
+      }
+      OutputBuffer(const OutputBuffer&) = delete;
+      OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+      template<typename T>
+      void put(T t)
+      {
+        const T tmp = boost::endian::native_to_little(t);
+        write(&tmp, sizeof(T));
+      }
+
+      void write(const void* data, size_t length)
+      {
+        if (m_target)
+        {
+          if (length > m_capacity - m_flushed)
+          {
+            throw std::runtime_error("Archive does not fit into the buffer");
+          }
+          if (length)
+          {
+            memcpy(m_target + m_flushed, data, length);
+          }
+          m_flushed += length;
+          return;
+        }
+        if (m_buffer.size() + length > m_capacity)
+        {
+          flush();
+          if (length >= m_capacity)
+          {
+            emit(data, length);
+            return;
+          }
+        }
+        const auto* begin = static_cast<const uint8_t*>(data);
+        m_buffer.insert(m_buffer.end(), begin, begin + length);
+      }
+
+      void flush()
+      {
+        if (!m_buffer.empty())
+        {
+          emit(m_buffer.data(), m_buffer.size());
+          m_buffer.clear();
+        }
+      }
+
+      /**
+       * Returns the number of bytes handed to the buffer so far.
+       */
+      auto written() const noexcept -> size_t
+      {
+        return m_flushed + m_buffer.size();
+      }
+
+    private:
+      void emit(const void* data, size_t length)
+      {
+        m_stream->write(static_cast<const char*>(data), static_cast<std::streamsize>(length));
+        if (!*m_stream)
+        {
+          throw std::runtime_error("Could not write archive");
+        }
+        m_flushed += length;
+      }
+
+      std::ostream* const m_stream;
+      uint8_t* const m_target;
+      const size_t m_capacity;
+      size_t m_flushed;
+      std::vector<uint8_t> m_buffer;
+    };
+
+    struct WriteToBuffer
+    {
+      typedef size_t result_type;
+
+      OutputBuffer& buffer;
+      WriteToBuffer(OutputBuffer& b) : buffer{b}
+      {
+      }
+      template<typename T>
+      size_t operator()(size_t acc, const T& t) const
+      {
+        buffer.put(t);
+        return acc + sizeof(T);
+      }
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_OUTPUT_BUFFER_H */
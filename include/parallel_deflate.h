@@ -0,0 +1,77 @@
+/**
+ * \file parallel_deflate.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_PARALLEL_DEFLATE_H
+#define INTERFACE_CPPZIP_PARALLEL_DEFLATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    struct DeflateResult
+    {
+      std::vector<uint8_t> data;
+      uint32_t crc32;
+    };
+
+    /**
+     * Compresses data into one raw deflate stream by splitting it into blocks which are
+     * compressed independently on a pool, in the style of pigz. Each block is primed with
+     * the last 32 KiB of the previous block as dictionary and all but the last one end with
+     * a sync flush, so the concatenation is a valid stream. The CRC is combined from the
+     * CRCs of the blocks.
+     */
+    auto parallelDeflate(const uint8_t* data, size_t length, int level, size_t block_size, unsigned threads)
+        -> DeflateResult;
+
+    /**
+     * Receives the compressed stream in order, piece by piece.
+     */
+    using DeflateSink_fn = std::function<void(const uint8_t*, size_t)>;
+
+    /**
+     * Like parallelDeflate but hands each block to sink once it and all before it are done.
+     * Only a few blocks are compressed ahead of the sink. Returns the CRC of data.
+     */
+    auto parallelDeflate(const uint8_t* data,
+                         size_t length,
+                         int level,
+                         size_t block_size,
+                         unsigned threads,
+                         const DeflateSink_fn& sink) -> uint32_t;
+
+    /**
+     * Compresses data with parallelDeflate if it spans more than one block and more than one
+     * thread is allowed, otherwise as one stream on the calling thread.
+     */
+    auto deflatePayload(const uint8_t* data, size_t length, int level, size_t block_size, unsigned threads)
+        -> DeflateResult;
+
+    /**
+     * Like deflatePayload but hands the compressed stream to sink as it is produced, so it is
+     * never held in memory as a whole. Returns the CRC of data.
+     */
+    auto deflatePayload(const uint8_t* data,
+                        size_t length,
+                        int level,
+                        size_t block_size,
+                        unsigned threads,
+                        const DeflateSink_fn& sink) -> uint32_t;
+
+    /**
+     * An upper bound of the compressed size deflatePayload produces.
+     */
+    auto deflatePayloadBound(uint64_t length, size_t block_size) -> uint64_t;
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_PARALLEL_DEFLATE_H */
@@ -0,0 +1,210 @@
+/**
+ * \file path_index.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_PATH_INDEX_H
+#define INTERFACE_CPPZIP_PATH_INDEX_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    /**
+     * Returns the directory in the form used by the entry names: empty for the root,
+     * otherwise with a single trailing '/'.
+     */
+    inline std::string normalizeDirectory(std::string directory)
+    {
+      while (!directory.empty() && directory.front() == '/')
+      {
+        directory.erase(0, 1);
+      }
+      if (!directory.empty() && directory.back() != '/')
+      {
+        directory.push_back('/');
+      }
+      return directory;
+    }
+
+    /**
+     * Matches an entry name against a glob pattern. '*' and '?' do not cross a '/',
+     * '**' matches any sequence including '/'.
+     */
+    inline bool globMatch(const char* pattern, const char* name)
+    {
+      while (*pattern)
+      {
+        if (pattern[0] == '*' && pattern[1] == '*')
+        {
+          pattern += 2;
+          // "a/**/b" also matches "a/b".
+          if (*pattern == '/' && globMatch(pattern + 1, name))
+          {
+            return true;
+          }
+          for (const char* n = name;; ++n)
+          {
+            if (globMatch(pattern, n))
+            {
+              return true;
+            }
+            if (!*n)
+            {
+              return false;
+            }
+          }
+        }
+        if (*pattern == '*')
+        {
+          ++pattern;
+          for (const char* n = name;; ++n)
+          {
+            if (globMatch(pattern, n))
+            {
+              return true;
+            }
+            if (!*n || *n == '/')
+            {
+              return false;
+            }
+          }
+        }
+        if (!*name || (*pattern == '?' ? *name == '/' : *pattern != *name))
+        {
+          return false;
+        }
+        ++pattern;
+        ++name;
+      }
+      return !*name;
+    }
+
+    /**
+     * A sorted index of entry names. Everything below a directory forms one contiguous
+     * range, so listings and prefix queries cost a lookup plus the size of the result.
+     */
+    template<typename T>
+    class PathIndex final
+    {
+    public:
+      using map_type = std::map<std::string, T, std::less<>>;
+
+      /**
+       * Adds the name unless it already exists. Returns false if the name was present.
+       */
+      bool insert(const std::string& name, T value)
+      {
+        return m_map.emplace(name, std::move(value)).second;
+      }
+
+      void assign(const std::string& name, T value)
+      {
+        m_map[name] = std::move(value);
+      }
+
+      bool erase(const std::string& name)
+      {
+        return m_map.erase(name) != 0;
+      }
+
+      void clear() noexcept
+      {
+        m_map.clear();
+      }
+
+      auto size() const noexcept -> size_t
+      {
+        return m_map.size();
+      }
+
+      auto find(const std::string& name) const -> const T*
+      {
+        const auto iter = m_map.find(name);
+        return iter == m_map.end() ? nullptr : &iter->second;
+      }
+
+      /**
+       * Calls fn(name, value) for every name below the given directory.
+       */
+      template<typename F>
+      void walk(const std::string& directory, F&& fn) const
+      {
+        const auto prefix = normalizeDirectory(directory);
+        for (auto iter = m_map.lower_bound(prefix); iter != m_map.end() && startsWith(iter->first, prefix); ++iter)
+        {
+          if (iter->first.size() != prefix.size())
+          {
+            fn(iter->first, iter->second);
+          }
+        }
+      }
+
+      /**
+       * Returns the names of the direct children of the directory. Sub directories are
+       * reported with a trailing '/' even when the archive has no entry for them; their
+       * content is skipped with a single lookup.
+       */
+      auto children(const std::string& directory) const -> std::vector<std::string>
+      {
+        const auto prefix = normalizeDirectory(directory);
+        std::vector<std::string> result;
+        auto iter = m_map.lower_bound(prefix);
+        while (iter != m_map.end() && startsWith(iter->first, prefix))
+        {
+          const auto slash = iter->first.find('/', prefix.size());
+          if (iter->first.size() == prefix.size())
+          {
+            ++iter;
+          }
+          else if (slash == std::string::npos)
+          {
+            result.push_back(iter->first);
+            ++iter;
+          }
+          else
+          {
+            auto child = iter->first.substr(0, slash + 1);
+            // '0' is the character following '/', so this skips the whole sub tree.
+            iter = m_map.lower_bound(child.substr(0, slash) + '0');
+            result.push_back(std::move(child));
+          }
+        }
+        return result;
+      }
+
+      /**
+       * Calls fn(name, value) for every name matching the glob pattern. Only the range
+       * sharing the literal prefix of the pattern is visited.
+       */
+      template<typename F>
+      void match(const std::string& pattern, F&& fn) const
+      {
+        const auto prefix = pattern.substr(0, pattern.find_first_of("*?"));
+        for (auto iter = m_map.lower_bound(prefix); iter != m_map.end() && startsWith(iter->first, prefix); ++iter)
+        {
+          if (globMatch(pattern.c_str(), iter->first.c_str()))
+          {
+            fn(iter->first, iter->second);
+          }
+        }
+      }
+
+    private:
+      static bool startsWith(const std::string& s, const std::string& prefix) noexcept
+      {
+        return s.compare(0, prefix.size(), prefix) == 0;
+      }
+
+      map_type m_map;
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_PATH_INDEX_H */
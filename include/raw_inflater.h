@@ -0,0 +1,86 @@
+/**
+ * \file raw_inflater.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_RAW_INFLATER_H
+#define INTERFACE_CPPZIP_RAW_INFLATER_H
+
+#include <algorithm>
+#include <batch_reader.h>
+#include <codec_pool.h>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    constexpr size_t inflate_chunk_size = 1 << 16;
+
+    /**
+     * Borrows a raw inflate stream from the pool and feeds it from the payload.
+     */
+    struct RawInflater final
+    {
+      RawInflater(const ReadAt_fn& r, uint64_t size, uint64_t start)
+        : read(r),
+          end{size},
+          pos{start},
+          input(inflate_chunk_size),
+          inflater{acquireInflater()},
+          strm{inflater->strm}
+      {
+      }
+      RawInflater(const RawInflater&) = delete;
+      RawInflater& operator=(const RawInflater&) = delete;
+
+      void fill()
+      {
+        const auto want = static_cast<size_t>(std::min<uint64_t>(input.size(), end - pos));
+        if (!want)
+        {
+          return;
+        }
+        const auto got = read(pos, input.data(), want);
+        if (!got)
+        {
+          throw std::runtime_error("Could not read payload");
+        }
+        pos += got;
+        strm.next_in = input.data();
+        strm.avail_in = static_cast<uInt>(got);
+      }
+
+      int step(int flush)
+      {
+        if (!strm.avail_in)
+        {
+          fill();
+        }
+        const int ret = inflate(&strm, flush);
+        if (ret == Z_BUF_ERROR && !strm.avail_in)
+        {
+          throw std::runtime_error("Unexpected end of deflate stream");
+        }
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+        {
+          throw std::runtime_error("File is corrupt");
+        }
+        return ret;
+      }
+
+      const ReadAt_fn& read;
+      const uint64_t end;
+      uint64_t pos;
+      std::vector<uint8_t> input;
+      InflaterPtr inflater;
+      z_stream& strm;
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_RAW_INFLATER_H */
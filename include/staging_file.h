@@ -0,0 +1,60 @@
+/**
+ * \file staging_file.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_STAGING_FILE_H
+#define INTERFACE_CPPZIP_STAGING_FILE_H
+
+#include <boost/filesystem.hpp>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    /**
+     * An anonymous temporary file holding compressed payloads which do not fit into the
+     * memory budget of an archive under construction. It disappears with the last handle.
+     */
+    class StagingFile final
+    {
+    public:
+      explicit StagingFile(const boost::filesystem::path& directory);
+      ~StagingFile();
+      StagingFile(const StagingFile&) = delete;
+      StagingFile& operator=(const StagingFile&) = delete;
+
+      /**
+       * Appends the data and returns the offset it was stored at.
+       */
+      auto append(const uint8_t* data, size_t length) -> uint64_t;
+
+      /**
+       * Reserves length bytes at the end and returns their offset. Parts left unwritten stay
+       * a hole.
+       */
+      auto reserve(uint64_t length) -> uint64_t;
+
+      void writeAt(uint64_t offset, const uint8_t* data, size_t length);
+
+      auto readAt(uint64_t offset, uint8_t* buffer, size_t length) const -> size_t;
+
+    private:
+      mutable std::mutex m_mutex;
+      uint64_t m_size = 0;
+#if defined(_WIN32)
+      boost::filesystem::path m_path;
+      mutable std::fstream m_file;
+#else
+      int m_fd = -1;
+#endif
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_STAGING_FILE_H */
@@ -0,0 +1,130 @@
+/**
+ * \file thread_pool.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_THREAD_POOL_H
+#define INTERFACE_CPPZIP_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    /**
+     * A fixed size pool of worker threads. Pending jobs are finished before the pool is destroyed.
+     * A job may destroy the pool, its worker then finishes on its own.
+     */
+    class ThreadPool final
+    {
+    public:
+      explicit ThreadPool(unsigned threads = 0) : m_state{std::make_shared<State>()}
+      {
+        const unsigned count = threads ? threads : defaultConcurrency();
+        m_workers.reserve(count);
+        for (unsigned i = 0; i < count; ++i)
+        {
+          m_workers.emplace_back([state = m_state] { run(*state); });
+        }
+      }
+      ThreadPool(const ThreadPool&) = delete;
+      ThreadPool& operator=(const ThreadPool&) = delete;
+
+      ~ThreadPool()
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_state->mutex);
+          m_state->stop = true;
+        }
+        m_state->cv.notify_all();
+        for (auto& t : m_workers)
+        {
+          if (t.get_id() == std::this_thread::get_id())
+          {
+            t.detach();
+          }
+          else
+          {
+            t.join();
+          }
+        }
+      }
+
+      static unsigned defaultConcurrency() noexcept
+      {
+        const unsigned n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+      }
+
+      auto size() const noexcept -> size_t
+      {
+        return m_workers.size();
+      }
+
+      void post(std::function<void()> job)
+      {
+        {
+          std::lock_guard<std::mutex> lock(m_state->mutex);
+          m_state->jobs.push_back(std::move(job));
+        }
+        m_state->cv.notify_one();
+      }
+
+      template<typename F>
+      auto submit(F&& f) -> std::future<decltype(f())>
+      {
+        using result_type = decltype(f());
+        auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(f));
+        auto result = task->get_future();
+        post([task] { (*task)(); });
+        return result;
+      }
+
+    private:
+      /**
+       * Shared with the workers, so a detached worker can still take the remaining jobs.
+       */
+      struct State
+      {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::function<void()>> jobs;
+        bool stop = false;
+      };
+
+      static void run(State& state)
+      {
+        for (;;)
+        {
+          std::function<void()> job;
+          {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.cv.wait(lock, [&state] { return state.stop || !state.jobs.empty(); });
+            if (state.jobs.empty())
+            {
+              return;
+            }
+            job = std::move(state.jobs.front());
+            state.jobs.pop_front();
+          }
+          job();
+        }
+      }
+
+      std::shared_ptr<State> m_state;
+      std::vector<std::thread> m_workers;
+    };
+  } // namespace detail
+} // namespace cppzip
+
+#endif /* INTERFACE_CPPZIP_THREAD_POOL_H */
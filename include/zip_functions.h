@@ -8,23 +8,15 @@
 #ifndef INTERFACE_CPPZIP_ZIP_V1_FUNCTIONS_H
 #define INTERFACE_CPPZIP_ZIP_V1_FUNCTIONS_H
 
+#include <cppzip/v1/dos_time.h>
+
 namespace cppzip
 {
   inline namespace v1
   {
       inline time_t datetime_to_timestamp(uint16_t date, uint16_t time)
       {
-        tm timeStruct;
-
-        timeStruct.tm_year = ((date >> 9) & 0x7f) + 80;
-        timeStruct.tm_mon = ((date >> 5) & 0x0f) - 1;
-        timeStruct.tm_mday = ((date)&0x1f);
-
-        timeStruct.tm_hour = ((time >> 11) & 0x1f);
-        timeStruct.tm_min = ((time >> 5) & 0x3f);
-        timeStruct.tm_sec = ((time << 1) & 0x3f);
-
-        return mktime(&timeStruct);
+        return dosTimeToTimestamp(static_cast<uint32_t>(date) << 16 | time);
       }
 
   }
@@ -0,0 +1,13 @@
+/**
+ * \file dos_time.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_DOS_TIME_H
+#define INTERFACE_CPPZIP_DOS_TIME_H
+
+#include <cppzip/v1/dos_time.h>
+
+#endif /* INTERFACE_CPPZIP_DOS_TIME_H */
@@ -0,0 +1,13 @@
+/**
+ * \file executor.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_EXECUTOR_H
+#define INTERFACE_CPPZIP_EXECUTOR_H
+
+#include <cppzip/v1/executor.h>
+
+#endif /* INTERFACE_CPPZIP_EXECUTOR_H */
@@ -0,0 +1,13 @@
+/**
+ * \file random_access_source.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_RANDOM_ACCESS_SOURCE_H
+#define INTERFACE_CPPZIP_RANDOM_ACCESS_SOURCE_H
+
+#include <cppzip/v1/random_access_source.h>
+
+#endif /* INTERFACE_CPPZIP_RANDOM_ACCESS_SOURCE_H */
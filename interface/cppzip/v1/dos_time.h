@@ -0,0 +1,40 @@
+/**
+ * \file dos_time.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_V1_DOS_TIME_H
+#define INTERFACE_CPPZIP_V1_DOS_TIME_H
+
+#include <cstdint>
+#include <ctime>
+
+namespace cppzip
+{
+  inline namespace v1
+  {
+    /**
+     * Converts an MS-DOS date and time in local time, date in the upper 16 bits, to a
+     * timestamp. The start of every quarter hour is converted with mktime once and cached
+     * per thread, so the time zone and daylight saving rules are honored without a lookup
+     * per call.
+     */
+    auto dosTimeToTimestamp(uint32_t dos_time) -> time_t;
+
+    /**
+     * Converts a timestamp to an MS-DOS date and time in local time with a resolution of
+     * two seconds. Times before 1980 are clamped. The local time of every quarter hour is
+     * cached per thread.
+     */
+    auto timestampToDosTime(time_t timestamp) -> uint32_t;
+
+    /**
+     * Drops the cached conversions of all threads, for example after the TZ environment
+     * variable was changed.
+     */
+    void resetDosTimeCache() noexcept;
+  } // namespace v1
+} // namespace cppzip
+#endif /* INTERFACE_CPPZIP_V1_DOS_TIME_H */
@@ -0,0 +1,24 @@
+/**
+ * \file executor.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_V1_EXECUTOR_H
+#define INTERFACE_CPPZIP_V1_EXECUTOR_H
+
+#include <functional>
+
+namespace cppzip
+{
+  inline namespace v1
+  {
+    /**
+     * Runs the given job at some point, usually on another thread. Used by the
+     * asynchronous functions of the archive and its entries.
+     */
+    using Executor = std::function<void(std::function<void()>)>;
+  } // namespace v1
+} // namespace cppzip
+#endif /* INTERFACE_CPPZIP_V1_EXECUTOR_H */
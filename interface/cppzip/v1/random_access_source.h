@@ -0,0 +1,68 @@
+/**
+ * \file random_access_source.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_V1_RANDOM_ACCESS_SOURCE_H
+#define INTERFACE_CPPZIP_V1_RANDOM_ACCESS_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace cppzip
+{
+  inline namespace v1
+  {
+    /**
+     * Storage an archive is read from by position, such as an object store or a remote block
+     * device. readAt may be called from several threads at once.
+     */
+    class RandomAccessSource
+    {
+    public:
+      virtual ~RandomAccessSource() = default;
+
+      /**
+       * Returns the size of the archive in bytes.
+       */
+      virtual auto size() const -> uint64_t = 0;
+
+      /**
+       * Reads up to length bytes at offset and returns the number of bytes read, which is less
+       * than length only at the end of the archive.
+       */
+      virtual auto readAt(uint64_t offset, uint8_t* buffer, size_t length) const -> size_t = 0;
+    };
+
+    /**
+     * Options of the block cache between an archive and its RandomAccessSource.
+     */
+    struct SourceCacheOptions
+    {
+      /**
+       * The unit the source is read and cached in.
+       */
+      size_t block_size = 64 << 10;
+
+      /**
+       * Blocks kept in memory, the least recently used one is dropped first.
+       */
+      size_t max_cached_blocks = 256;
+
+      /**
+       * While reads move forward, each one looks twice as many blocks ahead as the previous one,
+       * up to this many, and fetches those not cached yet. A read elsewhere starts over.
+       */
+      size_t max_readahead_blocks = 64;
+
+      /**
+       * Reads of at least this many bytes go to the source directly and are not cached.
+       */
+      size_t bypass_size = 4 << 20;
+    };
+  } // namespace v1
+} // namespace cppzip
+#endif /* INTERFACE_CPPZIP_V1_RANDOM_ACCESS_SOURCE_H */
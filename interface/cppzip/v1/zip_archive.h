@@ -9,6 +9,11 @@
 #define INTERFACE_CPPZIP_V1_ZIP_ARCHIVE_H
 
 #include <boost/filesystem.hpp>
+#include <cppzip/v1/executor.h>
+#include <cppzip/v1/random_access_source.h>
+#include <cppzip/v1/zip_entry.h>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <vector>
 
@@ -19,6 +24,196 @@ namespace cppzip
     class ZipEntry;
     using ZipEntryPtr = std::shared_ptr<ZipEntry>;
 
+    /**
+     * Options for reading many entries at once.
+     */
+    struct BulkReadOptions
+    {
+      /**
+       * The engine which issues the reads. Automatic uses io_uring when the kernel
+       * supports it and falls back to reads issued from the worker pool otherwise.
+       */
+      enum class Backend
+      {
+        Automatic,
+        IoUring,
+        ThreadPool
+      };
+
+      Backend backend = Backend::Automatic;
+
+      /**
+       * Number of decompression workers, 0 uses the hardware concurrency.
+       */
+      unsigned threads = 0;
+
+      /**
+       * Maximum number of reads in flight.
+       */
+      unsigned queue_depth = 64;
+
+      /**
+       * Entries are read in the order of their offsets. Payloads separated by at most this
+       * many bytes, the local headers between them included, are fetched with one read.
+       */
+      uint64_t coalesce_gap = 64 << 10;
+
+      /**
+       * Upper bound of a read covering several entries. Larger payloads are read on their own.
+       */
+      uint64_t max_coalesced_read = 8 << 20;
+    };
+
+    /**
+     * Options for compressing the data added to an archive.
+     */
+    struct CompressionOptions
+    {
+      /**
+       * The zlib compression level, -1 selects the zlib default.
+       */
+      int level = -1;
+
+      /**
+       * Number of threads compressing a single large entry, 0 uses the hardware concurrency.
+       * With 1 every entry is compressed as one sequential stream.
+       */
+      unsigned threads = 1;
+
+      /**
+       * Entries larger than this are split into blocks of this size which are compressed in
+       * parallel and joined into one deflate stream.
+       */
+      size_t block_size = 1 << 20;
+    };
+
+    /**
+     * Options for encrypting the entries added to an archive with WinZip AES (AE-2).
+     */
+    struct EncryptionOptions
+    {
+      enum class Strength : uint8_t
+      {
+        aes128 = 1,
+        aes192 = 2,
+        aes256 = 3
+      };
+
+      /**
+       * Entries are encrypted if the password is not empty.
+       */
+      std::string password;
+      Strength strength = Strength::aes256;
+    };
+
+    /**
+     * Limits the memory held by the compressed payloads of an archive under construction.
+     */
+    struct StagingOptions
+    {
+      /**
+       * Once the payloads kept in memory would exceed this many bytes, further payloads are
+       * moved to an anonymous temporary file until the archive is written.
+       */
+      uint64_t memory_budget = std::numeric_limits<uint64_t>::max();
+
+      /**
+       * Payloads smaller than this always stay in memory.
+       */
+      size_t min_staged_size = 64 << 10;
+
+      /**
+       * Where the temporary file is created, empty selects the system temporary directory.
+       */
+      boost::filesystem::path directory;
+    };
+
+    /**
+     * An on-disk cache of deflated payloads, shared by all archives built with the same directory.
+     */
+    struct CompressionCacheOptions
+    {
+      /**
+       * Where the payloads are kept, empty disables the cache. Several processes may use the
+       * same directory at once.
+       */
+      boost::filesystem::path directory;
+
+      /**
+       * Once the files exceed this many bytes, the least recently used ones are removed.
+       */
+      uint64_t max_size = uint64_t(1) << 30;
+
+      /**
+       * Smaller data is deflated directly, a file per entry would cost more than it saves.
+       */
+      size_t min_size = 4 << 10;
+    };
+
+    /**
+     * Options for adding a directory tree.
+     */
+    struct AddDirectoryOptions
+    {
+      /**
+       * Number of threads reading and compressing files, 0 uses the hardware concurrency.
+       */
+      unsigned threads = 0;
+
+      /**
+       * Upper bound of the file bytes read and compressed ahead of the entry being appended.
+       */
+      uint64_t max_in_flight_bytes = 256 << 20;
+    };
+
+    /**
+     * Decides whether a file or directory is added. Rejected directories are not descended into.
+     */
+    using PathFilter_fn = std::function<bool(const boost::filesystem::path&)>;
+
+    /**
+     * The metadata of all entries, one column per field in the order of the central directory.
+     */
+    struct EntrySnapshot
+    {
+      std::vector<std::string> names;
+      std::vector<CompressionMethod> methods;
+      std::vector<uint32_t> crc32s;
+      std::vector<uint64_t> compressed_sizes;
+      std::vector<uint64_t> uncompressed_sizes;
+
+      /**
+       * Offsets of the local file headers. Entries added since loading have 0 until the
+       * archive is written.
+       */
+      std::vector<uint64_t> offsets;
+      std::vector<time_t> timestamps;
+
+      auto size() const noexcept -> size_t
+      {
+        return names.size();
+      }
+    };
+
+    /**
+     * The result of verifying one entry. problems is empty if the entry is intact.
+     */
+    struct EntryReport
+    {
+      std::string name;
+      std::vector<std::string> problems;
+
+      bool ok() const noexcept
+      {
+        return problems.empty();
+      }
+    };
+
+    /**
+     * Receives the inflated content of an entry. Called concurrently from worker threads.
+     */
+    using EntryContent_fn = std::function<void(const ZipEntryPtr&, const std::vector<uint8_t>&)>;
+
     /**
      * The ZipArchive which represents a zip file or a in memory zip file
      */
@@ -33,17 +228,31 @@ namespace cppzip
       {
         ReadOnly,
         Write,
-        New
+        New,
+        Mapped ///< Read only, the file is mapped into memory
       };
 
       ZipArchive();
       ZipArchive(boost::filesystem::path path, OpenMode mode);
       ZipArchive(const std::vector<uint8_t>& data, OpenMode mode);
+
+      /**
+       * Open a read only archive over memory owned by the caller. The memory must outlive
+       * the archive and all of its entries.
+       */
+      ZipArchive(const uint8_t* data, size_t size);
+
+      /**
+       * Open a read only archive over a source supplied by the caller, such as an object store.
+       * Reads go through a block cache with readahead, so parsing the directory and reading
+       * small entries take few calls to the source.
+       */
+      explicit ZipArchive(std::shared_ptr<const RandomAccessSource> source, const SourceCacheOptions& options = {});
       ~ZipArchive();
       ZipArchive(const ZipArchive&) = delete;
-      ZipArchive(ZipArchive&&) = delete;
+      ZipArchive(ZipArchive&&) noexcept;
       ZipArchive& operator=(const ZipArchive&) = delete;
-      ZipArchive& operator=(ZipArchive&&) = delete;
+      ZipArchive& operator=(ZipArchive&&) noexcept;
 
       /**
        * Return the path of the ZipArchive. Empty when in memory
@@ -51,10 +260,15 @@ namespace cppzip
       auto getPath() const -> boost::filesystem::path;
 
       /**
-       * Returns true if the ZipArchive is encrypted.
+       * Returns true if any entry of the ZipArchive is encrypted.
        */
       bool isEncrypted() const noexcept;
 
+      /**
+       * Set the password used to decrypt the entries of the archive.
+       */
+      void setPassword(const std::string& password);
+
       /**
        * Set the comment of the archive.
        */
@@ -88,9 +302,48 @@ namespace cppzip
       auto getEntry(const std::string& name) const -> ZipEntryPtr;
 
       /**
-       * Renames the entry with the specified newName.
+       * Returns the metadata of all entries in one pass over the central directory.
+       */
+      auto getSnapshot() const -> EntrySnapshot;
+
+      /**
+       * Returns the names of the entries directly below the given directory ("" is the root).
+       * Sub directories end with '/' and are listed even if the archive has no entry for them.
        */
-      bool renameEntry(const std::string& entry, const std::string& newName) const;
+      auto listDirectory(const std::string& directory) const -> std::vector<std::string>;
+
+      /**
+       * Returns all the entries below the given directory, in name order.
+       */
+      auto walkDirectory(const std::string& directory) const -> std::vector<ZipEntryPtr>;
+
+      /**
+       * Returns the entries matching the glob pattern, in name order. '*' and '?' stay within
+       * one path component, '**' matches across components.
+       */
+      auto findEntries(const std::string& pattern) const -> std::vector<ZipEntryPtr>;
+
+      /**
+       * Renames the entry with the specified newName. Returns false if the entry does not exist
+       * or newName is taken. In a file a local record whose header does not fit the new name is
+       * copied to the end of the data area.
+       */
+      bool renameEntry(const std::string& entry, const std::string& newName);
+
+      /**
+       * Removes the entry with the specified name. Returns false if no such entry exists.
+       * On an archive opened with OpenMode::Write whose entries are all stored in the file,
+       * this and renameEntry only rewrite the central directory. The space of the removed
+       * record is reclaimed by compact.
+       */
+      bool removeEntry(const std::string& name);
+
+      /**
+       * Moves the local records of an archive opened with OpenMode::Write over the gaps left
+       * by removed entries without recompressing them, rewrites the central directory and
+       * truncates the file.
+       */
+      void compact();
 
       /**
        * Add the specified file in the archive with the given entry. If the entry already exists,
@@ -104,6 +357,92 @@ namespace cppzip
        */
       auto addData(const std::string& entryName, const void* data, uint64_t length) -> bool;
 
+      /**
+       * Add the specified entry and take ownership of its content. A stored entry keeps the
+       * buffer as its payload, otherwise the buffer is released once it is compressed.
+       */
+      auto addData(const std::string& entryName,
+                   std::vector<uint8_t>&& data,
+                   CompressionMethod method = CompressionMethod::defalted) -> bool;
+
+      /**
+       * Add an entry whose payload was compressed elsewhere, for example a raw deflate stream
+       * from a previous build, and write it as it is. The sizes and the method are checked, the
+       * CRC is trusted until verify. The payload is borrowed and must outlive the archive and
+       * all of its entries, unless the archive encrypts it.
+       */
+      auto addPrecompressed(const std::string& entryName,
+                            const void* payload,
+                            uint64_t compressedSize,
+                            uint32_t crc32,
+                            uint64_t uncompressedSize,
+                            CompressionMethod method = CompressionMethod::defalted) -> bool;
+
+      /**
+       * Like addPrecompressed above, but takes ownership of the payload.
+       */
+      auto addPrecompressed(const std::string& entryName,
+                            std::vector<uint8_t>&& payload,
+                            uint32_t crc32,
+                            uint64_t uncompressedSize,
+                            CompressionMethod method = CompressionMethod::defalted) -> bool;
+
+      /**
+       * Check every entry of the archive on the given number of threads (0 uses the hardware
+       * concurrency). Payloads are inflated into a discard sink and their CRC and sizes are
+       * compared with the local and the central headers. Local headers which overlap or lie
+       * outside the data area are reported as well. Returns one report per entry.
+       */
+      auto verify(unsigned threads = 0) const -> std::vector<EntryReport>;
+
+      /**
+       * Set the options used to compress the data of entries added from now on.
+       */
+      void setCompressionOptions(const CompressionOptions& options);
+
+      /**
+       * Set the memory budget for the payloads of entries added from now on.
+       */
+      void setStagingOptions(const StagingOptions& options);
+
+      /**
+       * Look up the data of entries added from now on in an on-disk cache of deflated payloads
+       * and store what had to be compressed. The data is keyed by its SHA-256 and the compression
+       * level, so identical data added to one archive is compressed only once as well.
+       */
+      void setCompressionCache(const CompressionCacheOptions& options);
+
+      /**
+       * Encrypt the entries added from now on. The payload is encrypted after compression,
+       * on the thread which compressed it.
+       */
+      void setEncryptionOptions(const EncryptionOptions& options);
+
+      /**
+       * Let addFile, addData and addEntry be called from several threads at once. Each call
+       * compresses on its own thread and queues the finished entry without touching the archive.
+       * Queued entries are added in name order by publishPendingEntries or writeArchive and are
+       * not visible before. No other function may run while adds are in progress. Disabling the
+       * mode publishes the queued entries.
+       */
+      void setConcurrentAdds(bool enabled);
+
+      /**
+       * Add the entries queued by concurrent adds to the archive.
+       */
+      void publishPendingEntries();
+
+      /**
+       * Add all files and directories below root whose path passes the filter. Entry names are
+       * the paths relative to root below prefix and are appended in sorted order. Files are
+       * read and compressed on a pool while earlier ones are appended. Returns the number of
+       * entries added.
+       */
+      auto addDirectory(const boost::filesystem::path& root,
+                        const std::string& prefix,
+                        const PathFilter_fn& filter = {},
+                        const AddDirectoryOptions& options = {}) -> size_t;
+
       /**
        * Add the specified entry to the ZipArchive. All the needed hierarchy will be created.
        * The entryName must be a directory.
@@ -115,6 +454,47 @@ namespace cppzip
 	   */
       void writeArchive(std::ostream& ofOutput);
 
+      /**
+       * Replace the content of output with the archive, allocating it once at its final size.
+       */
+      void writeArchive(std::vector<uint8_t>& output);
+
+      /**
+       * Write the archive into a buffer of the given size and return the number of bytes
+       * written. Throws if the buffer is smaller than computeArchiveSize.
+       */
+      auto writeArchive(uint8_t* data, size_t size) -> size_t;
+
+      /**
+       * Returns the exact number of bytes writeArchive produces. Entries queued by concurrent
+       * adds are published first.
+       */
+      auto computeArchiveSize() -> uint64_t;
+
+      /**
+       * Set the executor used by the asynchronous functions of the archive and its entries.
+       * By default a thread pool owned by the archive is used.
+       */
+      void setExecutor(Executor executor);
+
+      /**
+       * Read and inflate the content of every file entry with many reads in flight and
+       * hand it to the callback. The callback may be called from several threads at once.
+       */
+      void readAll(const EntryContent_fn& fn, const BulkReadOptions& options = {}) const;
+
+      /**
+       * Read and inflate the named entries like readAll. Throws if a name does not exist.
+       */
+      void readEntries(const std::vector<std::string>& names,
+                       const EntryContent_fn& fn,
+                       const BulkReadOptions& options = {}) const;
+
+      /**
+       * Extract all entries below the given directory using the bulk read engine.
+       */
+      void extractAll(const boost::filesystem::path& directory, const BulkReadOptions& options = {}) const;
+
     private:
       struct pimpl;
       std::unique_ptr<pimpl> impl;
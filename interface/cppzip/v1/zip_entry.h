@@ -9,11 +9,22 @@
 #define INTERFACE_CPPZIP_V1_ZIP_ENTRY_H
 
 #include <boost/filesystem.hpp>
+#include <cppzip/v1/executor.h>
+#include <exception>
+#include <future>
 #include <memory>
+#include <vector>
 
 namespace cppzip
 {
   struct LocalFileHeader;
+  namespace detail
+  {
+    class ArchiveSource;
+    class AsyncContext;
+    class OutputBuffer;
+    class StagingFile;
+  } // namespace detail
   enum class CompressionMethod
   {
     no = 0,
@@ -39,22 +50,46 @@ namespace cppzip
 
   inline namespace v1
   {
-    using FileRead_fn = std::function<long long(std::streamsize, std::ios::seekdir, uint8_t*, size_t)>;
+    struct CompressionOptions;
+    struct EncryptionOptions;
+
+    /**
+     * Receives the result of an asynchronous read. The exception is set if the read failed.
+     */
+    using ReadContent_fn = std::function<void(std::exception_ptr, std::vector<uint8_t>)>;
+
+    /**
+     * A read only view of bytes owned by the archive.
+     */
+    struct ContentView
+    {
+      const uint8_t* data;
+      size_t size;
+    };
+
     /**
      * The ZipEntry which represents an entry in a zip file
      */
-    class ZipEntry
+    class ZipEntry : public std::enable_shared_from_this<ZipEntry>
     {
       friend class ZipArchive;
-      ZipEntry(const LocalFileHeader& lf, size_t offset, FileRead_fn fn);
-      ZipEntry(const LocalFileHeader& lf, const void* data, std::uint64_t length);
+      ZipEntry(const LocalFileHeader& lf, size_t offset, std::shared_ptr<const detail::ArchiveSource> source);
+      ZipEntry(const LocalFileHeader& lf, const void* data, std::uint64_t length, const CompressionOptions& options);
+      ZipEntry(const LocalFileHeader& lf, std::vector<uint8_t>&& data, const CompressionOptions& options);
+      ZipEntry(const LocalFileHeader& lf,
+               const void* data,
+               std::uint64_t length,
+               const CompressionOptions& options,
+               std::shared_ptr<detail::StagingFile> staging);
+      ZipEntry(const LocalFileHeader& lf, const uint8_t* payload);
+      ZipEntry(const LocalFileHeader& lf, std::vector<uint8_t>&& payload);
 
     public:
       ~ZipEntry();
       ZipEntry(const ZipEntry&) = delete;
-      ZipEntry(ZipEntry&&) = delete;
+      ZipEntry(ZipEntry&&) noexcept;
       ZipEntry& operator=(const ZipEntry&) = delete;
-      ZipEntry& operator=(ZipEntry&&) = delete;
+      ZipEntry& operator=(ZipEntry&&) noexcept;
 
       /**
        * Returns the name of the entry.
@@ -72,10 +107,23 @@ namespace cppzip
       auto getCompressionMethod() const noexcept -> CompressionMethod;
 
       /**
-       * Returns the encryption method.
+       * Returns the encryption method: 0 if the entry is not encrypted, the strong encryption
+       * algorithm id (0x660E, 0x660F or 0x6610) for WinZip AES with 128, 192 or 256 bit keys
+       * and 1 for the traditional PKWARE encryption, which cannot be read.
        */
       auto getEncryptionMethod() const noexcept -> uint16_t;
 
+      /**
+       * Returns true if the payload of the entry is encrypted.
+       */
+      bool isEncrypted() const noexcept;
+
+      /**
+       * Set the password used to decrypt the entry. Reads fail with "Wrong password" if the
+       * verifier stored with the entry does not match.
+       */
+      void setPassword(const std::string& password);
+
       /**
        * Returns the size of the file (not deflated).
        */
@@ -116,9 +164,79 @@ namespace cppzip
        */
       auto readContent(std::ostream& ofOutput) const -> int64_t;
 
+      /**
+       * Read and inflate the entry on the executor of the archive, or on the given one.
+       */
+      auto readContentAsync(const Executor& executor = {}) const -> std::future<std::vector<uint8_t>>;
+
+      /**
+       * Read and inflate the entry on the executor of the archive, or on the given one, and
+       * pass the result to the callback on the executor thread. This form can be wrapped in
+       * an awaitable by coroutine based callers.
+       */
+      void readContentAsync(ReadContent_fn fn, const Executor& executor = {}) const;
+
+      /**
+       * Returns true if the content can be viewed in place: the entry is stored and the
+       * archive is mapped or in memory, or the entry was added from an owned buffer.
+       */
+      bool hasView() const noexcept;
+
+      /**
+       * Returns the content of a stored entry without copying it. The view points into the
+       * archive and stays valid as long as the entry. The CRC is only checked if verify is set.
+       */
+      auto getView(bool verify = false) const -> ContentView;
+
+      /**
+       * Returns up to length bytes of the inflated content starting at offset. Stored entries
+       * are read in place, deflated entries are inflated from the closest access point of the
+       * index, which is built on first use. Encrypted entries are decrypted, but only reads of the
+       * whole content check their authentication code.
+       */
+      auto readRange(uint64_t offset, size_t length) const -> std::vector<uint8_t>;
+
+      /**
+       * Build the access point index of a deflated entry with a restart point about every
+       * spacing bytes of inflated content.
+       */
+      void buildIndex(uint64_t spacing = 1 << 20);
+
+      /**
+       * Write the access point index so it can be reused with loadIndex.
+       */
+      void saveIndex(std::ostream& out) const;
+
+      /**
+       * Load an index written by saveIndex. Returns false if it belongs to other content or is
+       * damaged.
+       */
+      bool loadIndex(std::istream& in);
+
+      /**
+       * Write the content to a file, or create the directory. Stored entries of a file backed
+       * archive are copied by the kernel and their CRC is only checked if verify is set;
+       * deflated entries are always checked. Returns the number of bytes written.
+       */
+      auto extractTo(const boost::filesystem::path& path, bool verify = false) const -> uint64_t;
+
     private:
-      size_t writeEntry(std::ostream& ofOutput);
+      size_t writeEntry(detail::OutputBuffer& out);
+      auto recordSize() const noexcept -> uint64_t;
       size_t compressedSize() const;
+      size_t dataOffset() const;
+      auto cachedData() const -> const std::vector<uint8_t>&;
+      auto localHeader() const -> const LocalFileHeader&;
+      auto decodeContent(const uint8_t* data, size_t length) const -> std::vector<uint8_t>;
+      void setAsyncContext(std::weak_ptr<detail::AsyncContext> context);
+      void encrypt(const EncryptionOptions& options);
+      void setName(const std::string& name);
+      void relocate(size_t offset) noexcept;
+      void stage(const std::shared_ptr<detail::StagingFile>& file);
+      bool isStaged() const noexcept;
+      bool isInSource() const noexcept;
+      auto loadContent() const -> std::vector<uint8_t>;
+      auto payloadReader() const -> std::function<size_t(uint64_t, uint8_t*, size_t)>;
 
       struct pimpl;
       std::unique_ptr<pimpl> impl;
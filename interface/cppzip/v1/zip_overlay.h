@@ -0,0 +1,105 @@
+/**
+ * \file zip_overlay.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_V1_ZIP_OVERLAY_H
+#define INTERFACE_CPPZIP_V1_ZIP_OVERLAY_H
+
+#include <boost/filesystem.hpp>
+#include <cppzip/v1/zip_archive.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cppzip
+{
+  inline namespace v1
+  {
+    /**
+     * Options of a ZipOverlay.
+     */
+    struct OverlayOptions
+    {
+      /**
+       * Maximum number of archives kept open at once. Each open archive holds one file handle
+       * or mapping, the least recently used one is closed when the limit is reached. Closing
+       * drops the whole archive, so opening it again parses its central directory again.
+       */
+      size_t max_open_archives = 16;
+
+      /**
+       * The mode the archives are opened in, ReadOnly or Mapped.
+       */
+      ZipArchive::OpenMode mode = ZipArchive::OpenMode::ReadOnly;
+    };
+
+    /**
+     * Several archives mounted on top of each other and looked up through one merged index.
+     * An entry of a later mounted archive hides the entries with the same name below it.
+     * Lookups may be called from several threads at once.
+     */
+    class ZipOverlay final
+    {
+    public:
+      explicit ZipOverlay(const OverlayOptions& options = {});
+      ~ZipOverlay();
+      ZipOverlay(const ZipOverlay&) = delete;
+      ZipOverlay(ZipOverlay&&) noexcept;
+      ZipOverlay& operator=(const ZipOverlay&) = delete;
+      ZipOverlay& operator=(ZipOverlay&&) noexcept;
+
+      /**
+       * Mounts the archive above all mounted ones. Returns false if it is already mounted.
+       */
+      bool mount(const boost::filesystem::path& path);
+
+      /**
+       * Removes the archive, the entries it hid become visible again. Returns false if it is
+       * not mounted.
+       */
+      bool unmount(const boost::filesystem::path& path);
+
+      /**
+       * Returns the mounted archives from the bottom to the top.
+       */
+      auto getMounts() const -> std::vector<boost::filesystem::path>;
+
+      /**
+       * Returns the number of distinct entry names.
+       */
+      auto getNumberOfEntries() const -> size_t;
+
+      auto hasEntry(const std::string& name) const -> bool;
+
+      /**
+       * Returns the path of the archive providing the entry, empty if there is none.
+       */
+      auto getArchivePath(const std::string& name) const -> boost::filesystem::path;
+
+      /**
+       * Returns the entry from the top most archive containing it, or a null-ZipEntry. An
+       * archive which was closed by the pool is opened again. The entry keeps the handle of
+       * its archive open for as long as it lives.
+       */
+      auto getEntry(const std::string& name) const -> ZipEntryPtr;
+
+      /**
+       * Returns the names directly below the given directory of the merged tree.
+       */
+      auto listDirectory(const std::string& directory) const -> std::vector<std::string>;
+
+      /**
+       * Returns the names of the merged tree matching the glob pattern, in name order.
+       */
+      auto findEntries(const std::string& pattern) const -> std::vector<std::string>;
+
+    private:
+      struct pimpl;
+      std::unique_ptr<pimpl> impl;
+    };
+  } // namespace v1
+} // namespace cppzip
+#endif /* INTERFACE_CPPZIP_V1_ZIP_OVERLAY_H */
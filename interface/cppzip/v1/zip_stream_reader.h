@@ -0,0 +1,115 @@
+/**
+ * \file zip_stream_reader.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_V1_ZIP_STREAM_READER_H
+#define INTERFACE_CPPZIP_V1_ZIP_STREAM_READER_H
+
+#include <cppzip/v1/zip_entry.h>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace cppzip
+{
+  inline namespace v1
+  {
+    /**
+     * Reads an archive front to back from a stream which can not seek, like a pipe or a
+     * socket. The entries are visited in the order of their local file headers and their
+     * content is inflated while it arrives. If the archive ends with a central directory
+     * it is checked against the entries seen.
+     */
+    class ZipStreamReader final
+    {
+    public:
+      /**
+       * The input must outlive the reader. Nothing is read before the first call of next.
+       */
+      explicit ZipStreamReader(std::istream& input);
+      ~ZipStreamReader();
+      ZipStreamReader(const ZipStreamReader&) = delete;
+      ZipStreamReader(ZipStreamReader&&) = delete;
+      ZipStreamReader& operator=(const ZipStreamReader&) = delete;
+      ZipStreamReader& operator=(ZipStreamReader&&) = delete;
+
+      /**
+       * Advances to the next entry, skipping what is left of the current one. Returns false
+       * at the central directory or at the end of the input.
+       */
+      bool next();
+
+      /**
+       * Returns the name of the current entry.
+       */
+      auto getEntryName() const -> std::string;
+
+      /**
+       * Returns the timestamp of the current entry.
+       */
+      auto getDate() const noexcept -> time_t;
+
+      /**
+       * Returns the compression method of the current entry.
+       */
+      auto getCompressionMethod() const noexcept -> CompressionMethod;
+
+      /**
+       * Returns true if the sizes and the CRC follow the content. They are only known once
+       * the content has been read completely.
+       */
+      bool hasDataDescriptor() const noexcept;
+
+      /**
+       * Returns the compressed size of the current entry.
+       */
+      auto getCompressedSize() const noexcept -> uint64_t;
+
+      /**
+       * Returns the uncompressed size of the current entry.
+       */
+      auto getUncompressedSize() const noexcept -> uint64_t;
+
+      /**
+       * Returns the CRC of the current entry.
+       */
+      auto getCRC() const noexcept -> uint32_t;
+
+      /**
+       * Returns true if the current entry is a directory.
+       */
+      bool isDirectory() const noexcept;
+
+      /**
+       * Reads up to length bytes of the inflated content of the current entry. Returns 0 at
+       * its end, where the CRC and the sizes are checked.
+       */
+      auto read(void* buffer, size_t length) -> size_t;
+
+      /**
+       * Reads the remaining content of the current entry.
+       */
+      auto readContent(std::ostream& ofOutput) -> int64_t;
+
+      /**
+       * Returns a stream over the content of the current entry. It is invalidated by next.
+       */
+      auto getStream() -> std::istream&;
+
+      /**
+       * Returns true once next has reached a central directory and found it consistent
+       * with the entries.
+       */
+      bool hasCentralDirectory() const noexcept;
+
+    private:
+      struct pimpl;
+      std::unique_ptr<pimpl> impl;
+    };
+  } // namespace v1
+} // namespace cppzip
+#endif /* INTERFACE_CPPZIP_V1_ZIP_STREAM_READER_H */
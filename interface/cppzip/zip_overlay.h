@@ -0,0 +1,13 @@
+/**
+ * \file zip_overlay.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_ZIP_OVERLAY_H
+#define INTERFACE_CPPZIP_ZIP_OVERLAY_H
+
+#include <cppzip/v1/zip_overlay.h>
+
+#endif /* INTERFACE_CPPZIP_ZIP_OVERLAY_H */
@@ -0,0 +1,13 @@
+/**
+ * \file zip_stream_reader.h
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#ifndef INTERFACE_CPPZIP_ZIP_STREAM_READER_H
+#define INTERFACE_CPPZIP_ZIP_STREAM_READER_H
+
+#include <cppzip/v1/zip_stream_reader.h>
+
+#endif /* INTERFACE_CPPZIP_ZIP_STREAM_READER_H */
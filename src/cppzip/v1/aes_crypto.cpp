@@ -0,0 +1,284 @@
+/**
+ * \file aes_crypto.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <aes_crypto.h>
+#include <algorithm>
+#include <boost/endian/conversion.hpp>
+#include <cstring>
+#include <helper.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <stdexcept>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    namespace
+    {
+      constexpr int pbkdf2_iterations = 1000;
+      constexpr size_t aes_block_size = 16;
+
+      /**
+       * Counter blocks encrypted per call, enough to keep the AES units busy.
+       */
+      constexpr size_t key_stream_blocks = 256;
+
+      /**
+       * Payloads are encrypted and authenticated in chunks of this size, so the second pass over
+       * a chunk finds it in the cache.
+       */
+      constexpr size_t crypt_chunk_size = 64 << 10;
+
+      auto cipherFor(uint8_t strength) -> const EVP_CIPHER*
+      {
+        switch (strength)
+        {
+        case 1:
+          return EVP_aes_128_ecb();
+        case 2:
+          return EVP_aes_192_ecb();
+        case 3:
+          return EVP_aes_256_ecb();
+        default:
+          throw std::runtime_error("Unknown AES strength");
+        }
+      }
+
+      void writeUint16(std::vector<uint8_t>& out, uint16_t value)
+      {
+        out.push_back(static_cast<uint8_t>(value));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+      }
+    } // namespace
+
+    bool findAesField(const std::vector<uint8_t>& extra, AesField& field)
+    {
+      for (size_t pos = 0; pos + 4 <= extra.size();)
+      {
+        uint16_t id;
+        uint16_t length;
+        ReadFromArray read{extra.data() + pos};
+        read(id);
+        read(length);
+        if (pos + 4 + length > extra.size())
+        {
+          return false;
+        }
+        if (id == aes_extra_field_id && length >= 7)
+        {
+          const auto* data = extra.data() + pos + 4;
+          ReadFromArray{data}(field.version);
+          field.strength = data[4];
+          ReadFromArray{data + 5}(field.method);
+          return data[2] == 'A' && data[3] == 'E';
+        }
+        pos += 4 + length;
+      }
+      return false;
+    }
+
+    auto makeAesField(const AesField& field) -> std::vector<uint8_t>
+    {
+      std::vector<uint8_t> result;
+      writeUint16(result, aes_extra_field_id);
+      writeUint16(result, 7);
+      writeUint16(result, field.version);
+      result.push_back('A');
+      result.push_back('E');
+      result.push_back(field.strength);
+      writeUint16(result, field.method);
+      return result;
+    }
+
+    auto deriveAesKeys(const std::string& password, const uint8_t* salt, uint8_t strength) -> AesKeys
+    {
+      const auto key_size = aesKeySize(strength);
+      std::vector<uint8_t> material(2 * key_size + aes_verifier_size);
+      if (PKCS5_PBKDF2_HMAC_SHA1(password.data(), static_cast<int>(password.size()), salt,
+                                 static_cast<int>(aesSaltSize(strength)), pbkdf2_iterations,
+                                 static_cast<int>(material.size()), material.data()) != 1)
+      {
+        throw std::runtime_error("Could not derive keys");
+      }
+      AesKeys keys;
+      keys.strength = strength;
+      keys.cipher.assign(material.begin(), material.begin() + key_size);
+      keys.mac.assign(material.begin() + key_size, material.begin() + 2 * key_size);
+      std::copy(material.end() - aes_verifier_size, material.end(), keys.verifier.begin());
+      return keys;
+    }
+
+    AesCtr::AesCtr(const AesKeys& keys) : m_ctx{EVP_CIPHER_CTX_new()}
+    {
+      if (!m_ctx || EVP_EncryptInit_ex(m_ctx, cipherFor(keys.strength), nullptr, keys.cipher.data(), nullptr) != 1)
+      {
+        EVP_CIPHER_CTX_free(m_ctx);
+        throw std::runtime_error("Could not initialize AES");
+      }
+      EVP_CIPHER_CTX_set_padding(m_ctx, 0);
+    }
+
+    AesCtr::~AesCtr()
+    {
+      EVP_CIPHER_CTX_free(m_ctx);
+    }
+
+    void AesCtr::crypt(uint64_t position, uint8_t* data, size_t length)
+    {
+      uint8_t stream[key_stream_blocks * aes_block_size];
+      while (length)
+      {
+        const auto block = position / aes_block_size;
+        const auto skip = static_cast<size_t>(position % aes_block_size);
+        const auto count = std::min(key_stream_blocks, (skip + length + aes_block_size - 1) / aes_block_size);
+        std::memset(stream, 0, count * aes_block_size);
+        for (size_t i = 0; i < count; ++i)
+        {
+          const auto counter = boost::endian::native_to_little(block + 1 + i);
+          std::memcpy(stream + i * aes_block_size, &counter, sizeof(counter));
+        }
+        int produced = 0;
+        if (EVP_EncryptUpdate(m_ctx, stream, &produced, stream, static_cast<int>(count * aes_block_size)) != 1)
+        {
+          throw std::runtime_error("Could not encrypt");
+        }
+        const auto n = std::min(length, count * aes_block_size - skip);
+        for (size_t i = 0; i < n; ++i)
+        {
+          data[i] ^= stream[skip + i];
+        }
+        data += n;
+        position += n;
+        length -= n;
+      }
+    }
+
+    AesMac::AesMac(const AesKeys& keys)
+      : m_key{EVP_PKEY_new_raw_private_key(EVP_PKEY_HMAC, nullptr, keys.mac.data(), keys.mac.size())},
+        m_ctx{EVP_MD_CTX_new()}
+    {
+      if (!m_key || !m_ctx || EVP_DigestSignInit(m_ctx, nullptr, EVP_sha1(), nullptr, m_key) != 1)
+      {
+        EVP_MD_CTX_free(m_ctx);
+        EVP_PKEY_free(m_key);
+        throw std::runtime_error("Could not initialize HMAC");
+      }
+    }
+
+    AesMac::~AesMac()
+    {
+      EVP_MD_CTX_free(m_ctx);
+      EVP_PKEY_free(m_key);
+    }
+
+    void AesMac::update(const uint8_t* data, size_t length)
+    {
+      if (EVP_DigestSignUpdate(m_ctx, data, length) != 1)
+      {
+        throw std::runtime_error("Could not authenticate");
+      }
+    }
+
+    auto AesMac::finish() -> std::array<uint8_t, aes_mac_size>
+    {
+      uint8_t digest[EVP_MAX_MD_SIZE];
+      size_t size = sizeof(digest);
+      if (EVP_DigestSignFinal(m_ctx, digest, &size) != 1 || size < aes_mac_size)
+      {
+        throw std::runtime_error("Could not authenticate");
+      }
+      std::array<uint8_t, aes_mac_size> result;
+      std::copy(digest, digest + aes_mac_size, result.begin());
+      return result;
+    }
+
+    AesReader::AesReader(ReadAt_fn read, const AesKeys& keys, uint64_t offset, uint64_t length)
+      : m_read{std::move(read)}, m_ctr{keys}, m_mac{keys}, m_offset{offset}, m_length{length}
+    {
+    }
+
+    auto AesReader::read(uint64_t position, uint8_t* buffer, size_t length) -> size_t
+    {
+      if (position >= m_length)
+      {
+        return 0;
+      }
+      length = static_cast<size_t>(std::min<uint64_t>(length, m_length - position));
+      const auto n = m_read(m_offset + position, buffer, length);
+      if (position == m_authenticated)
+      {
+        m_mac.update(buffer, n);
+        m_authenticated += n;
+      }
+      m_ctr.crypt(position, buffer, n);
+      return n;
+    }
+
+    bool AesReader::authentic(const uint8_t* mac)
+    {
+      if (m_authenticated != m_length)
+      {
+        return false;
+      }
+      const auto expected = m_mac.finish();
+      return std::equal(expected.begin(), expected.end(), mac);
+    }
+
+    auto aesEncrypt(const std::string& password, uint8_t strength, const std::vector<uint8_t>& payload)
+        -> std::vector<uint8_t>
+    {
+      const auto salt_size = aesSaltSize(strength);
+      const auto header = salt_size + aes_verifier_size;
+      std::vector<uint8_t> result(header + payload.size() + aes_mac_size);
+      if (RAND_bytes(result.data(), static_cast<int>(salt_size)) != 1)
+      {
+        throw std::runtime_error("Could not create salt");
+      }
+      const auto keys = deriveAesKeys(password, result.data(), strength);
+      std::copy(keys.verifier.begin(), keys.verifier.end(), result.begin() + salt_size);
+      auto* data = result.data() + header;
+      std::copy(payload.begin(), payload.end(), data);
+      AesCtr ctr{keys};
+      AesMac mac{keys};
+      for (size_t pos = 0; pos < payload.size(); pos += crypt_chunk_size)
+      {
+        const auto n = std::min(crypt_chunk_size, payload.size() - pos);
+        ctr.crypt(pos, data + pos, n);
+        mac.update(data + pos, n);
+      }
+      const auto code = mac.finish();
+      std::copy(code.begin(), code.end(), data + payload.size());
+      return result;
+    }
+
+    auto aesDecrypt(const AesKeys& keys, const uint8_t* payload, size_t length) -> std::vector<uint8_t>
+    {
+      const auto header = aesSaltSize(keys.strength) + aes_verifier_size;
+      if (length < header + aes_mac_size)
+      {
+        throw std::runtime_error("File is corrupt");
+      }
+      const auto size = length - header - aes_mac_size;
+      std::vector<uint8_t> result(payload + header, payload + header + size);
+      AesCtr ctr{keys};
+      AesMac mac{keys};
+      for (size_t pos = 0; pos < size; pos += crypt_chunk_size)
+      {
+        const auto n = std::min(crypt_chunk_size, size - pos);
+        mac.update(result.data() + pos, n);
+        ctr.crypt(pos, result.data() + pos, n);
+      }
+      const auto code = mac.finish();
+      if (!std::equal(code.begin(), code.end(), payload + header + size))
+      {
+        throw std::runtime_error("File is corrupt");
+      }
+      return result;
+    }
+  } // namespace detail
+} // namespace cppzip
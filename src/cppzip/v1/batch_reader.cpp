@@ -0,0 +1,414 @@
+/**
+ * \file batch_reader.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <batch_reader.h>
+#include <cstring>
+#include <memory>
+#include <thread_pool.h>
+
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    define CPPZIP_HAS_IO_URING 1
+#  endif
+#endif
+
+#ifdef CPPZIP_HAS_IO_URING
+#  include <cerrno>
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+namespace cppzip
+{
+  namespace detail
+  {
+    namespace
+    {
+      /**
+       * Keeps track of the work handed to the pool and of the first error raised by it.
+       */
+      class Pending final
+      {
+      public:
+        explicit Pending(size_t limit) : m_limit{limit}, m_count{}
+        {
+        }
+
+        void acquire()
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_cv.wait(lock, [this] { return m_count < m_limit; });
+          ++m_count;
+        }
+
+        bool tryAcquire()
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          if (m_count >= m_limit)
+          {
+            return false;
+          }
+          ++m_count;
+          return true;
+        }
+
+        void release(std::exception_ptr error = nullptr)
+        {
+          {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_count;
+            if (error && !m_error)
+            {
+              m_error = error;
+            }
+          }
+          m_cv.notify_all();
+        }
+
+        void waitAll()
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_cv.wait(lock, [this] { return m_count == 0; });
+        }
+
+        void waitBelowLimit()
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_cv.wait(lock, [this] { return m_count < m_limit; });
+        }
+
+        bool failed()
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          return static_cast<bool>(m_error);
+        }
+
+        void rethrow()
+        {
+          if (m_error)
+          {
+            std::rethrow_exception(m_error);
+          }
+        }
+
+      private:
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        const size_t m_limit;
+        size_t m_count;
+        std::exception_ptr m_error;
+      };
+
+      void readFully(const ReadSource& source, const BatchItem& item, std::vector<uint8_t>& data, size_t done)
+      {
+        while (done < data.size())
+        {
+          const auto res = source.read_at(item.offset + done, data.data() + done, data.size() - done);
+          if (res == 0)
+          {
+            throw std::runtime_error("Could not read payload");
+          }
+          done += res;
+        }
+      }
+
+      void consume(Pending& pending,
+                   const BatchConsumer& consumer,
+                   size_t index,
+                   std::vector<uint8_t>& data) noexcept
+      {
+        try
+        {
+          consumer(index, data);
+          pending.release();
+        }
+        catch (...)
+        {
+          pending.release(std::current_exception());
+        }
+      }
+
+#ifdef CPPZIP_HAS_IO_URING
+      /**
+       * A minimal io_uring submission and completion ring used for positional reads.
+       */
+      class Uring final
+      {
+      public:
+        Uring(unsigned entries)
+          : m_ring_fd{-1}
+          , m_sq_ptr{MAP_FAILED}
+          , m_cq_ptr{MAP_FAILED}
+          , m_sqes{static_cast<io_uring_sqe*>(MAP_FAILED)}
+          , m_to_submit{}
+        {
+          std::memset(&m_params, 0, sizeof(m_params));
+          m_ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &m_params));
+          if (m_ring_fd < 0)
+          {
+            return;
+          }
+          m_sq_size = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned);
+          m_cq_size = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+          const bool single = (m_params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+          if (single)
+          {
+            m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+          }
+          m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd,
+                          IORING_OFF_SQ_RING);
+          if (m_sq_ptr == MAP_FAILED)
+          {
+            return;
+          }
+          m_cq_ptr = single ? m_sq_ptr
+                            : mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd,
+                                   IORING_OFF_CQ_RING);
+          if (m_cq_ptr == MAP_FAILED)
+          {
+            return;
+          }
+          m_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_params.sq_entries * sizeof(io_uring_sqe),
+                                                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd,
+                                                   IORING_OFF_SQES));
+          auto* sq = static_cast<uint8_t*>(m_sq_ptr);
+          auto* cq = static_cast<uint8_t*>(m_cq_ptr);
+          m_sq_tail = reinterpret_cast<unsigned*>(sq + m_params.sq_off.tail);
+          m_sq_mask = reinterpret_cast<unsigned*>(sq + m_params.sq_off.ring_mask);
+          m_sq_array = reinterpret_cast<unsigned*>(sq + m_params.sq_off.array);
+          m_cq_head = reinterpret_cast<unsigned*>(cq + m_params.cq_off.head);
+          m_cq_tail = reinterpret_cast<unsigned*>(cq + m_params.cq_off.tail);
+          m_cq_mask = reinterpret_cast<unsigned*>(cq + m_params.cq_off.ring_mask);
+          m_cqes = reinterpret_cast<io_uring_cqe*>(cq + m_params.cq_off.cqes);
+        }
+        Uring(const Uring&) = delete;
+        Uring& operator=(const Uring&) = delete;
+
+        ~Uring()
+        {
+          if (m_sqes != MAP_FAILED)
+          {
+            munmap(m_sqes, m_params.sq_entries * sizeof(io_uring_sqe));
+          }
+          if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+          {
+            munmap(m_cq_ptr, m_cq_size);
+          }
+          if (m_sq_ptr != MAP_FAILED)
+          {
+            munmap(m_sq_ptr, m_sq_size);
+          }
+          if (m_ring_fd >= 0)
+          {
+            close(m_ring_fd);
+          }
+        }
+
+        bool valid() const noexcept
+        {
+          return m_ring_fd >= 0 && m_sq_ptr != MAP_FAILED && m_cq_ptr != MAP_FAILED && m_sqes != MAP_FAILED;
+        }
+
+        auto capacity() const noexcept -> unsigned
+        {
+          return m_params.sq_entries;
+        }
+
+        void prepareRead(int fd, uint64_t offset, uint8_t* buffer, size_t length, uint64_t user_data)
+        {
+          const unsigned tail = *m_sq_tail;
+          const unsigned index = tail & *m_sq_mask;
+          io_uring_sqe* sqe = &m_sqes[index];
+          std::memset(sqe, 0, sizeof(*sqe));
+          sqe->opcode = IORING_OP_READ;
+          sqe->fd = fd;
+          sqe->off = offset;
+          sqe->addr = reinterpret_cast<uint64_t>(buffer);
+          sqe->len = static_cast<uint32_t>(length);
+          sqe->user_data = user_data;
+          m_sq_array[index] = index;
+          __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+          ++m_to_submit;
+        }
+
+        void submitAndWait(unsigned wait_nr)
+        {
+          for (;;)
+          {
+            const auto res = syscall(__NR_io_uring_enter, m_ring_fd, m_to_submit, wait_nr,
+                                     wait_nr ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+            if (res >= 0)
+            {
+              m_to_submit -= static_cast<unsigned>(res);
+              return;
+            }
+            if (errno != EINTR)
+            {
+              throw std::runtime_error("io_uring_enter failed");
+            }
+          }
+        }
+
+        template<typename F>
+        void reap(F&& f)
+        {
+          unsigned head = *m_cq_head;
+          const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+          while (head != tail)
+          {
+            const io_uring_cqe& cqe = m_cqes[head & *m_cq_mask];
+            f(cqe.user_data, cqe.res);
+            ++head;
+          }
+          __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        }
+
+      private:
+        int m_ring_fd;
+        io_uring_params m_params;
+        size_t m_sq_size;
+        size_t m_cq_size;
+        void* m_sq_ptr;
+        void* m_cq_ptr;
+        io_uring_sqe* m_sqes;
+        unsigned* m_sq_tail;
+        unsigned* m_sq_mask;
+        unsigned* m_sq_array;
+        unsigned* m_cq_head;
+        unsigned* m_cq_tail;
+        unsigned* m_cq_mask;
+        io_uring_cqe* m_cqes;
+        unsigned m_to_submit;
+      };
+
+      /**
+       * Submits reads through the ring from the calling thread and feeds the completed
+       * buffers to the pool. Returns false if the ring could not be set up.
+       */
+      bool readWithUring(const ReadSource& source,
+                         const std::vector<BatchItem>& items,
+                         unsigned depth,
+                         ThreadPool& pool,
+                         Pending& pending,
+                         const BatchConsumer& consumer)
+      {
+        Uring ring(depth);
+        if (!ring.valid())
+        {
+          return false;
+        }
+        depth = std::min(depth, ring.capacity());
+
+        std::vector<std::shared_ptr<std::vector<uint8_t>>> buffers(items.size());
+        size_t next = 0;
+        unsigned in_flight = 0;
+        auto dispatch = [&](size_t index) {
+          auto data = std::move(buffers[index]);
+          pool.post([&pending, &consumer, index, data] { consume(pending, consumer, index, *data); });
+        };
+
+        while ((next < items.size() || in_flight) && !pending.failed())
+        {
+          // Work handed to the pool is bounded by the same limit as the reads in flight,
+          // so slow consumers stall the submission instead of growing the buffers.
+          while (next < items.size() && in_flight < depth && pending.tryAcquire())
+          {
+            const auto& item = items[next];
+            buffers[next] = std::make_shared<std::vector<uint8_t>>(item.length);
+            if (item.length)
+            {
+              ring.prepareRead(source.fd, item.offset, buffers[next]->data(), item.length, next);
+              ++in_flight;
+            }
+            else
+            {
+              dispatch(next);
+            }
+            ++next;
+          }
+          if (!in_flight)
+          {
+            pending.waitBelowLimit();
+            continue;
+          }
+          ring.submitAndWait(1);
+          ring.reap([&](uint64_t index, int res) {
+            --in_flight;
+            auto& data = *buffers[index];
+            try
+            {
+              // Short reads and kernels without IORING_OP_READ are completed synchronously.
+              readFully(source, items[index], data, res > 0 ? static_cast<size_t>(res) : 0);
+              dispatch(index);
+            }
+            catch (...)
+            {
+              buffers[index].reset();
+              pending.release(std::current_exception());
+            }
+          });
+        }
+        while (in_flight)
+        {
+          ring.submitAndWait(1);
+          ring.reap([&](uint64_t index, int) {
+            --in_flight;
+            buffers[index].reset();
+            pending.release();
+          });
+        }
+        return true;
+      }
+#endif
+    } // namespace
+
+    void readBatch(const ReadSource& source,
+                   const std::vector<BatchItem>& items,
+                   const BulkReadOptions& options,
+                   const BatchConsumer& consumer)
+    {
+      const unsigned depth = std::min(std::max(options.queue_depth, 1u), 4096u);
+      const unsigned threads = options.threads ? options.threads : ThreadPool::defaultConcurrency();
+      Pending pending(std::max(depth, threads));
+      ThreadPool pool(threads);
+
+      bool done = false;
+#ifdef CPPZIP_HAS_IO_URING
+      if (source.fd >= 0 && options.backend != BulkReadOptions::Backend::ThreadPool)
+      {
+        done = readWithUring(source, items, depth, pool, pending, consumer);
+      }
+#endif
+      if (!done && options.backend == BulkReadOptions::Backend::IoUring)
+      {
+        throw std::runtime_error("io_uring is not available");
+      }
+      for (size_t i = 0; !done && i < items.size() && !pending.failed(); ++i)
+      {
+        pending.acquire();
+        pool.post([&source, &items, &pending, &consumer, i] {
+          std::vector<uint8_t> data(items[i].length);
+          try
+          {
+            readFully(source, items[i], data, 0);
+          }
+          catch (...)
+          {
+            pending.release(std::current_exception());
+            return;
+          }
+          consume(pending, consumer, i, data);
+        });
+      }
+      pending.waitAll();
+      pending.rethrow();
+    }
+  } // namespace detail
+} // namespace cppzip
@@ -0,0 +1,192 @@
+/**
+ * \file cached_source.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <cached_source.h>
+#include <cstring>
+#include <stdexcept>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    CachedSource::CachedSource(std::shared_ptr<const RandomAccessSource> source, const SourceCacheOptions& options)
+      : m_source{std::move(source)}, m_options{options}, m_size{m_source->size()}
+    {
+      if (!m_options.block_size || !m_options.max_cached_blocks)
+      {
+        throw std::runtime_error("Invalid cache options");
+      }
+    }
+
+    auto CachedSource::readAt(uint64_t offset, uint8_t* buffer, size_t length) const -> size_t
+    {
+      if (offset >= m_size)
+      {
+        return 0;
+      }
+      length = static_cast<size_t>(std::min<uint64_t>(length, m_size - offset));
+      if (!length)
+      {
+        return 0;
+      }
+      if (length >= m_options.bypass_size)
+      {
+        return m_source->readAt(offset, buffer, length);
+      }
+      const uint64_t block_size = m_options.block_size;
+      const auto first = offset / block_size;
+      const auto last = (offset + length - 1) / block_size;
+      std::vector<BlockPtr> needed;
+      std::vector<Run> runs;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Reads moving forward within the window grow it, others start over.
+        if (offset >= m_next_offset && offset - m_next_offset <= (m_readahead + 1) * block_size)
+        {
+          m_readahead = std::min(m_options.max_readahead_blocks, std::max<size_t>(1, m_readahead * 2));
+        }
+        else
+        {
+          m_readahead = 0;
+        }
+        m_next_offset = offset + length;
+        // The window has to fit into the cache next to the blocks being read.
+        const uint64_t span = last + 1 - first;
+        const uint64_t room = m_options.max_cached_blocks > span ? m_options.max_cached_blocks - span : 0;
+        const auto end =
+            std::min((m_size + block_size - 1) / block_size, last + 1 + std::min<uint64_t>(m_readahead, room));
+        for (auto index = first; index < end; ++index)
+        {
+          auto iter = m_blocks.find(index);
+          if (iter != m_blocks.end())
+          {
+            m_lru.splice(m_lru.begin(), m_lru, iter->second->lru);
+          }
+          else
+          {
+            auto block = std::make_shared<Block>();
+            m_lru.push_front(index);
+            block->lru = m_lru.begin();
+            iter = m_blocks.emplace(index, std::move(block)).first;
+            if (runs.empty() || runs.back().first + runs.back().blocks.size() != index)
+            {
+              runs.push_back({index, {}});
+            }
+            runs.back().blocks.push_back(iter->second);
+          }
+          if (index <= last)
+          {
+            needed.push_back(iter->second);
+          }
+        }
+        // The blocks being read are the most recent ones, so eviction takes the readahead first.
+        for (const auto& block : needed)
+        {
+          m_lru.splice(m_lru.begin(), m_lru, block->lru);
+        }
+        evict();
+      }
+      for (const auto& run : runs)
+      {
+        fetch(run);
+      }
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_fetched.wait(lock, [&needed] {
+          return std::all_of(needed.begin(), needed.end(), [](const BlockPtr& b) { return b->ready; });
+        });
+      }
+      size_t done = 0;
+      for (size_t i = 0; i < needed.size(); ++i)
+      {
+        const auto& block = *needed[i];
+        if (block.error)
+        {
+          std::rethrow_exception(block.error);
+        }
+        const auto skip = static_cast<size_t>(i ? 0 : offset % block_size);
+        if (skip >= block.data.size())
+        {
+          break;
+        }
+        const auto n = std::min(length - done, block.data.size() - skip);
+        std::memcpy(buffer + done, block.data.data() + skip, n);
+        done += n;
+      }
+      return done;
+    }
+
+    void CachedSource::fetch(const Run& run) const
+    {
+      const uint64_t block_size = m_options.block_size;
+      const auto offset = run.first * block_size;
+      std::vector<uint8_t> data(static_cast<size_t>(
+          std::min<uint64_t>(run.blocks.size() * block_size, m_size - offset)));
+      std::exception_ptr error;
+      size_t got = 0;
+      try
+      {
+        got = m_source->readAt(offset, data.data(), data.size());
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (size_t i = 0; i < run.blocks.size(); ++i)
+      {
+        auto& block = *run.blocks[i];
+        const auto begin = std::min<size_t>(got, i * block_size);
+        const auto end = std::min<size_t>(got, begin + block_size);
+        block.data.assign(data.begin() + begin, data.begin() + end);
+        block.error = error;
+        block.ready = true;
+        if (error || end - begin < std::min<uint64_t>(block_size, m_size - (run.first + i) * block_size))
+        {
+          // Failed or short reads are not kept, so the next read tries again.
+          const auto iter = m_blocks.find(run.first + i);
+          if (iter != m_blocks.end() && iter->second == run.blocks[i])
+          {
+            m_lru.erase(block.lru);
+            m_blocks.erase(iter);
+          }
+        }
+      }
+      m_fetched.notify_all();
+    }
+
+    void CachedSource::evict() const
+    {
+      for (auto iter = m_lru.end(); m_blocks.size() > m_options.max_cached_blocks && iter != m_lru.begin();)
+      {
+        --iter;
+        const auto found = m_blocks.find(*iter);
+        if (found->second->ready)
+        {
+          iter = m_lru.erase(iter);
+          m_blocks.erase(found);
+        }
+      }
+    }
+
+    auto CachedSource::size() const -> uint64_t
+    {
+      return m_size;
+    }
+
+    int CachedSource::nativeHandle() const noexcept
+    {
+      return -1;
+    }
+
+    auto CachedSource::data() const noexcept -> const uint8_t*
+    {
+      return nullptr;
+    }
+  } // namespace detail
+} // namespace cppzip
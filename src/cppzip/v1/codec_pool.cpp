@@ -0,0 +1,217 @@
+/**
+ * \file codec_pool.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <codec_pool.h>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    namespace
+    {
+      /**
+       * Streams kept per thread. A deflate stream holds about 256 KiB, an inflate stream
+       * about 40 KiB once its window is allocated.
+       */
+      constexpr size_t max_pooled_codecs = 4;
+
+      constexpr uInt max_zlib_chunk = std::numeric_limits<uInt>::max();
+
+      template<typename T>
+      struct CodecPool
+      {
+        std::vector<std::unique_ptr<T>> free;
+
+        void release(T* codec) noexcept
+        {
+          std::unique_ptr<T> owned{codec};
+          if (free.size() < max_pooled_codecs)
+          {
+            try
+            {
+              free.push_back(std::move(owned));
+            }
+            catch (...)
+            {
+            }
+          }
+        }
+      };
+
+      thread_local CodecPool<Deflater> deflaters;
+      thread_local CodecPool<Inflater> inflaters;
+
+      /**
+       * A reset keeps the buffers of the previous user, which callers may rely on being empty.
+       */
+      void clearBuffers(z_stream& strm) noexcept
+      {
+        strm.next_in = nullptr;
+        strm.avail_in = 0;
+        strm.next_out = nullptr;
+        strm.avail_out = 0;
+      }
+    } // namespace
+
+    Deflater::Deflater(int l) : level{l}
+    {
+      std::memset(&strm, 0, sizeof(strm));
+      if (deflateInit2(&strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+        throw std::runtime_error("Could not initialize deflate");
+      }
+    }
+
+    Deflater::~Deflater()
+    {
+      deflateEnd(&strm);
+    }
+
+    Inflater::Inflater()
+    {
+      std::memset(&strm, 0, sizeof(strm));
+      if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+      {
+        throw std::runtime_error("Could not initialize inflate");
+      }
+    }
+
+    Inflater::~Inflater()
+    {
+      inflateEnd(&strm);
+    }
+
+    void CodecRelease::operator()(Deflater* deflater) const noexcept
+    {
+      deflaters.release(deflater);
+    }
+
+    void CodecRelease::operator()(Inflater* inflater) const noexcept
+    {
+      inflaters.release(inflater);
+    }
+
+    auto acquireDeflater(int level) -> DeflaterPtr
+    {
+      auto& pool = deflaters.free;
+      // A stream with the same level needs no parameter change.
+      auto iter = std::find_if(pool.begin(), pool.end(),
+                               [level](const std::unique_ptr<Deflater>& d) { return d->level == level; });
+      if (iter == pool.end() && !pool.empty())
+      {
+        iter = pool.end() - 1;
+      }
+      if (iter == pool.end())
+      {
+        return DeflaterPtr{new Deflater(level)};
+      }
+      DeflaterPtr deflater{iter->release()};
+      pool.erase(iter);
+      if (deflateReset(&deflater->strm) != Z_OK)
+      {
+        throw std::runtime_error("Could not initialize deflate");
+      }
+      clearBuffers(deflater->strm);
+      if (deflater->level != level)
+      {
+        if (deflateParams(&deflater->strm, level, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+          throw std::runtime_error("Could not initialize deflate");
+        }
+        deflater->level = level;
+      }
+      return deflater;
+    }
+
+    auto acquireInflater() -> InflaterPtr
+    {
+      auto& pool = inflaters.free;
+      if (pool.empty())
+      {
+        return InflaterPtr{new Inflater()};
+      }
+      InflaterPtr inflater{pool.back().release()};
+      pool.pop_back();
+      if (inflateReset(&inflater->strm) != Z_OK)
+      {
+        throw std::runtime_error("Could not initialize inflate");
+      }
+      clearBuffers(inflater->strm);
+      return inflater;
+    }
+
+    auto deflateRaw(const uint8_t* data, size_t length, int level) -> std::vector<uint8_t>
+    {
+      const auto deflater = acquireDeflater(level);
+      auto& strm = deflater->strm;
+      std::vector<uint8_t> result(deflateBound(&strm, static_cast<uLong>(length)));
+      strm.next_in = const_cast<Bytef*>(data);
+      strm.next_out = result.data();
+      size_t left = length;
+      int ret = Z_OK;
+      while (ret != Z_STREAM_END)
+      {
+        const auto chunk = static_cast<uInt>(std::min<size_t>(left, max_zlib_chunk));
+        strm.avail_in = chunk;
+        strm.avail_out = static_cast<uInt>(std::min<size_t>(result.size() - strm.total_out, max_zlib_chunk));
+        ret = deflate(&strm, chunk == left ? Z_FINISH : Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END)
+        {
+          throw std::runtime_error("Could not compress data");
+        }
+        left -= chunk - strm.avail_in;
+      }
+      result.resize(strm.total_out);
+      return result;
+    }
+
+    auto inflateRaw(const uint8_t* data, size_t length, size_t expected_size) -> std::vector<uint8_t>
+    {
+      const auto inflater = acquireInflater();
+      auto& strm = inflater->strm;
+      // The expected size comes from the headers and may be forged, the stream inflates to at most
+      // 1032 times its size.
+      std::vector<uint8_t> result(std::max<size_t>(std::min<size_t>(expected_size, length * 1032 + 258), 1));
+      strm.next_in = const_cast<Bytef*>(data);
+      size_t left = length;
+      size_t produced = 0;
+      for (;;)
+      {
+        if (produced == result.size())
+        {
+          result.resize(result.size() * 2);
+        }
+        const auto chunk = static_cast<uInt>(std::min<size_t>(left, max_zlib_chunk));
+        strm.avail_in = chunk;
+        strm.next_out = result.data() + produced;
+        strm.avail_out = static_cast<uInt>(std::min<size_t>(result.size() - produced, max_zlib_chunk));
+        const auto out_before = strm.avail_out;
+        const int ret = inflate(&strm, Z_NO_FLUSH);
+        produced += out_before - strm.avail_out;
+        left -= chunk - strm.avail_in;
+        if (ret == Z_STREAM_END)
+        {
+          break;
+        }
+        if (ret == Z_BUF_ERROR && !left)
+        {
+          throw std::runtime_error("Unexpected end of deflate stream");
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+          throw std::runtime_error("File is corrupt");
+        }
+      }
+      result.resize(produced);
+      return result;
+    }
+  } // namespace detail
+} // namespace cppzip
@@ -0,0 +1,277 @@
+/**
+ * \file compression_cache.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <array>
+#include <boost/endian/conversion.hpp>
+#include <compression_cache.h>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <helper.h>
+#include <limits>
+#include <openssl/evp.h>
+#include <stdexcept>
+#include <vector>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    namespace
+    {
+      constexpr std::array<char, 4> magic{{'C', 'Z', 'C', '1'}};
+
+      /**
+       * The magic, the CRC of the content, the CRC of the payload, the length of the content
+       * and the length of the payload.
+       */
+      constexpr size_t header_size = 28;
+
+      /**
+       * Eviction stops below this share of the cap, so the directory is not scanned on every store.
+       */
+      constexpr uint64_t low_water_percent = 90;
+
+      /**
+       * Temporary files of writers which died are removed after this many seconds.
+       */
+      constexpr std::time_t stale_temporary_age = 3600;
+
+      struct CachedFile
+      {
+        std::time_t time;
+        uint64_t size;
+        boost::filesystem::path path;
+      };
+
+      bool isTemporary(const boost::filesystem::path& path)
+      {
+        return path.extension() == ".tmp";
+      }
+
+      /**
+       * Lists the files of the cache. Files removed by other processes meanwhile are skipped.
+       */
+      auto listFiles(const boost::filesystem::path& directory) -> std::vector<CachedFile>
+      {
+        std::vector<CachedFile> files;
+        boost::system::error_code ec;
+        for (boost::filesystem::recursive_directory_iterator it(directory, ec), end; !ec && it != end;
+             it.increment(ec))
+        {
+          boost::system::error_code file_ec;
+          if (!boost::filesystem::is_regular_file(it->status(file_ec)))
+          {
+            continue;
+          }
+          const auto size = boost::filesystem::file_size(it->path(), file_ec);
+          const auto time = boost::filesystem::last_write_time(it->path(), file_ec);
+          if (!file_ec)
+          {
+            files.push_back({time, size, it->path()});
+          }
+        }
+        return files;
+      }
+
+      auto contentKey(const uint8_t* data, size_t length, int level) -> std::string
+      {
+        uint8_t digest[EVP_MAX_MD_SIZE];
+        unsigned size = 0;
+        if (EVP_Digest(data, length, digest, &size, EVP_sha256(), nullptr) != 1)
+        {
+          throw std::runtime_error("Could not hash content");
+        }
+        static const char hex[] = "0123456789abcdef";
+        std::string key;
+        for (unsigned i = 0; i < size; ++i)
+        {
+          key.push_back(hex[digest[i] >> 4]);
+          key.push_back(hex[digest[i] & 15]);
+        }
+        return key + "-" + std::to_string(level);
+      }
+
+      template<typename T>
+      void put(uint8_t*& out, T value)
+      {
+        value = boost::endian::native_to_little(value);
+        std::memcpy(out, &value, sizeof(value));
+        out += sizeof(value);
+      }
+
+      template<typename T>
+      auto get(const uint8_t*& in) -> T
+      {
+        T value;
+        std::memcpy(&value, in, sizeof(value));
+        in += sizeof(value);
+        return boost::endian::little_to_native(value);
+      }
+    } // namespace
+
+    CompressionCache::CompressionCache(boost::filesystem::path directory, uint64_t max_size)
+      : m_directory{std::move(directory)}, m_max_size{max_size}
+    {
+      boost::filesystem::create_directories(m_directory);
+      for (const auto& file : listFiles(m_directory))
+      {
+        m_size += isTemporary(file.path) ? 0 : file.size;
+      }
+    }
+
+    auto CompressionCache::deflate(const uint8_t* data, size_t length, int level, const Deflate_fn& fn)
+        -> DeflateResult
+    {
+      const auto key = contentKey(data, length, level);
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stored.wait(lock, [this, &key] { return !m_in_flight.count(key); });
+        m_in_flight.insert(key);
+      }
+      struct Release
+      {
+        CompressionCache& cache;
+        const std::string& key;
+        ~Release()
+        {
+          std::lock_guard<std::mutex> lock(cache.m_mutex);
+          cache.m_in_flight.erase(key);
+          cache.m_stored.notify_all();
+        }
+      } release{*this, key};
+
+      const auto path = pathOf(key);
+      DeflateResult result;
+      if (load(path, length, result))
+      {
+        return result;
+      }
+      result = fn();
+      store(path, length, result);
+      return result;
+    }
+
+    auto CompressionCache::pathOf(const std::string& key) const -> boost::filesystem::path
+    {
+      return m_directory / key.substr(0, 2) / key;
+    }
+
+    bool CompressionCache::load(const boost::filesystem::path& path, uint64_t length, DeflateResult& result) const
+    {
+      std::ifstream in(path.c_str(), std::ios::binary);
+      std::array<uint8_t, header_size> header;
+      if (!in.read(reinterpret_cast<char*>(header.data()), header.size()) ||
+          !std::equal(magic.begin(), magic.end(), header.begin()))
+      {
+        return false;
+      }
+      const auto* cursor = header.data() + magic.size();
+      const auto crc = get<uint32_t>(cursor);
+      const auto payload_crc = get<uint32_t>(cursor);
+      const auto content_length = get<uint64_t>(cursor);
+      const auto payload_length = get<uint64_t>(cursor);
+      if (content_length != length || payload_length > std::numeric_limits<uint32_t>::max())
+      {
+        return false;
+      }
+      std::vector<uint8_t> payload(static_cast<size_t>(payload_length));
+      if (!in.read(reinterpret_cast<char*>(payload.data()), static_cast<std::streamsize>(payload.size())) ||
+          in.peek() != std::ifstream::traits_type::eof() || getCrc32(payload.data(), payload.size()) != payload_crc)
+      {
+        return false;
+      }
+      result.data = std::move(payload);
+      result.crc32 = crc;
+      // The modification time orders the files for eviction.
+      boost::system::error_code ec;
+      boost::filesystem::last_write_time(path, std::time(nullptr), ec);
+      return true;
+    }
+
+    void CompressionCache::store(const boost::filesystem::path& path, uint64_t length, const DeflateResult& result)
+    {
+      // A cache which cannot be written only costs the next build the compression.
+      boost::system::error_code ec;
+      boost::filesystem::create_directories(path.parent_path(), ec);
+      const auto temporary = path.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%.tmp");
+      {
+        std::array<uint8_t, header_size> header;
+        std::copy(magic.begin(), magic.end(), header.begin());
+        auto* cursor = header.data() + magic.size();
+        put<uint32_t>(cursor, result.crc32);
+        put<uint32_t>(cursor, getCrc32(result.data.data(), result.data.size()));
+        put<uint64_t>(cursor, length);
+        put<uint64_t>(cursor, result.data.size());
+        std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(header.data()), header.size());
+        out.write(reinterpret_cast<const char*>(result.data.data()), static_cast<std::streamsize>(result.data.size()));
+        if (!out.flush())
+        {
+          out.close();
+          boost::filesystem::remove(temporary, ec);
+          return;
+        }
+      }
+      boost::filesystem::rename(temporary, path, ec);
+      if (ec)
+      {
+        boost::filesystem::remove(temporary, ec);
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_size += header_size + result.data.size();
+        if (m_size <= m_max_size || m_evicting)
+        {
+          return;
+        }
+        m_evicting = true;
+      }
+      evict();
+    }
+
+    void CompressionCache::evict()
+    {
+      // Other processes write to the directory as well, so it is scanned instead of trusting m_size.
+      auto files = listFiles(m_directory);
+      const auto now = std::time(nullptr);
+      uint64_t total = 0;
+      boost::system::error_code ec;
+      files.erase(std::remove_if(files.begin(), files.end(),
+                                 [&](const CachedFile& file) {
+                                   if (!isTemporary(file.path))
+                                   {
+                                     total += file.size;
+                                     return false;
+                                   }
+                                   if (now - file.time > stale_temporary_age)
+                                   {
+                                     boost::filesystem::remove(file.path, ec);
+                                   }
+                                   return true;
+                                 }),
+                  files.end());
+      std::sort(files.begin(), files.end(), [](const CachedFile& a, const CachedFile& b) { return a.time < b.time; });
+      const auto target = m_max_size / 100 * low_water_percent;
+      for (const auto& file : files)
+      {
+        if (total <= target)
+        {
+          break;
+        }
+        // A file another process removed first is gone as well.
+        boost::filesystem::remove(file.path, ec);
+        total -= file.size;
+      }
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_size = total;
+      m_evicting = false;
+    }
+  } // namespace detail
+} // namespace cppzip
@@ -0,0 +1,131 @@
+/**
+ * \file dos_time.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cppzip/v1/dos_time.h>
+
+namespace cppzip
+{
+  inline namespace v1
+  {
+    namespace
+    {
+      constexpr size_t cache_slots = 256;
+      static_assert(cache_slots == 1 << 8, "the slot is the top byte of the hash");
+
+      /**
+       * Every time zone offset is a multiple of a quarter hour, so the local time inside
+       * such a range of UTC only differs by the seconds passed.
+       */
+      constexpr time_t quarter_hour = 15 * 60;
+
+      std::atomic<unsigned> cache_generation{0};
+
+      template<typename Key, typename Value>
+      struct Slot
+      {
+        Key key;
+        Value value;
+        unsigned generation;
+        bool valid;
+      };
+
+      /**
+       * A direct mapped cache, one per thread so lookups take no lock.
+       */
+      template<typename Key, typename Value>
+      class ConversionCache final
+      {
+      public:
+        template<typename F>
+        auto get(Key key, F&& convert) -> const Value&
+        {
+          const auto generation = cache_generation.load(std::memory_order_relaxed);
+          // Fibonacci hashing, the top byte of the product depends on every bit of the key. The low
+          // byte would only depend on the hour and the quarter, or on the seconds of a timestamp.
+          auto& slot = m_slots[static_cast<size_t>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> 56)];
+          if (!slot.valid || slot.key != key || slot.generation != generation)
+          {
+            slot = {key, convert(key), generation, true};
+          }
+          return slot.value;
+        }
+
+      private:
+        std::array<Slot<Key, Value>, cache_slots> m_slots{};
+      };
+
+      bool toLocalTime(time_t timestamp, tm& result)
+      {
+#if defined(_WIN32)
+        return localtime_s(&result, &timestamp) == 0;
+#else
+        return localtime_r(&timestamp, &result) != nullptr;
+#endif
+      }
+
+      uint32_t makeDosTime(const tm& t) noexcept
+      {
+        const auto date = static_cast<uint32_t>(((t.tm_year - 80) << 9) + ((t.tm_mon + 1) << 5) + t.tm_mday);
+        const auto time = static_cast<uint32_t>((t.tm_hour << 11) + (t.tm_min << 5) + (t.tm_sec >> 1));
+        return date << 16 | time;
+      }
+    } // namespace
+
+    auto dosTimeToTimestamp(uint32_t dos_time) -> time_t
+    {
+      thread_local ConversionCache<uint32_t, time_t> cache;
+      // The date, the hour and the quarter of the hour select the cached start of the quarter,
+      // daylight saving changes by half an hour happen on such a boundary as well.
+      const uint32_t minute = (dos_time >> 5) & 0x3f;
+      const uint32_t quarter = std::min<uint32_t>(minute / 15, 3);
+      const auto quarter_start = cache.get((dos_time >> 11) << 2 | quarter, [](uint32_t key) {
+        tm t{};
+        t.tm_year = ((key >> 16) & 0x7f) + 80;
+        t.tm_mon = ((key >> 12) & 0x0f) - 1;
+        t.tm_mday = (key >> 7) & 0x1f;
+        t.tm_hour = (key >> 2) & 0x1f;
+        t.tm_min = (key & 0x03) * 15;
+        t.tm_isdst = -1;
+        return mktime(&t);
+      });
+      return quarter_start + (minute - quarter * 15) * 60 + (dos_time & 0x1f) * 2;
+    }
+
+    auto timestampToDosTime(time_t timestamp) -> uint32_t
+    {
+      constexpr uint32_t dos_epoch = (1 << 5 | 1) << 16;
+      if (timestamp < 0)
+      {
+        return dos_epoch;
+      }
+      thread_local ConversionCache<time_t, tm> cache;
+      const time_t start = timestamp - timestamp % quarter_hour;
+      tm t = cache.get(start, [](time_t key) {
+        tm result{};
+        toLocalTime(key, result);
+        return result;
+      });
+      const auto passed = static_cast<int>(timestamp - start);
+      t.tm_min += passed / 60;
+      t.tm_sec += passed % 60;
+      if (t.tm_min > 59 || t.tm_sec > 59)
+      {
+        // A historic offset which is not a multiple of a quarter hour.
+        toLocalTime(timestamp, t);
+      }
+      return t.tm_year < 80 ? dos_epoch : makeDosTime(t);
+    }
+
+    void resetDosTimeCache() noexcept
+    {
+      cache_generation.fetch_add(1, std::memory_order_relaxed);
+    }
+  } // namespace v1
+} // namespace cppzip
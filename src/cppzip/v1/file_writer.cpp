@@ -0,0 +1,276 @@
+/**
+ * \file file_writer.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <cstdlib>
+#include <file_writer.h>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_WIN32)
+#  include <malloc.h>
+#else
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+#if defined(__linux__)
+#  include <sys/sendfile.h>
+#endif
+
+namespace cppzip
+{
+  namespace detail
+  {
+#if defined(_WIN32)
+    FileWriter::FileWriter(const boost::filesystem::path& path)
+      : m_path{path}, m_file{path.wstring(), std::ios::out | std::ios::binary | std::ios::trunc}
+    {
+      if (!m_file)
+      {
+        throw std::runtime_error("Could not open " + m_path.string());
+      }
+    }
+
+    FileWriter::~FileWriter() = default;
+
+    void FileWriter::preallocate(uint64_t)
+    {
+    }
+
+    void FileWriter::copyFrom(int, uint64_t, uint64_t)
+    {
+      throw std::runtime_error("Could not copy payload");
+    }
+
+    void FileWriter::write(const uint8_t* data, size_t length)
+    {
+      if (!m_file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length)))
+      {
+        throw std::runtime_error("Could not write " + m_path.string());
+      }
+    }
+
+    void FileWriter::close()
+    {
+      m_file.close();
+      if (!m_file)
+      {
+        throw std::runtime_error("Could not write " + m_path.string());
+      }
+    }
+#else
+    FileWriter::FileWriter(const boost::filesystem::path& path) : m_path{path}
+    {
+      m_fd = ::open(path.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (m_fd < 0)
+      {
+        throw std::runtime_error("Could not open " + m_path.string());
+      }
+    }
+
+    FileWriter::~FileWriter()
+    {
+      if (m_fd >= 0)
+      {
+        ::close(m_fd);
+      }
+    }
+
+    void FileWriter::preallocate(uint64_t size)
+    {
+#  if defined(__linux__)
+      // The size stays at what was written, so a failed extraction does not leave a padded file.
+      if (size)
+      {
+        ::fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+      }
+#  else
+      (void)size;
+#  endif
+    }
+
+    void FileWriter::copyFrom(int fd, uint64_t offset, uint64_t length)
+    {
+      auto pos = static_cast<off_t>(offset);
+      auto left = length;
+#  if defined(__linux__)
+      // copy_file_range shares extents on reflink capable file systems, sendfile still
+      // avoids the copies through user space when source and target are on different ones.
+      bool copy_range = true;
+      while (left)
+      {
+        const auto n = static_cast<size_t>(std::min<uint64_t>(left, 1 << 30));
+        const auto res =
+            copy_range ? ::copy_file_range(fd, &pos, m_fd, nullptr, n, 0) : ::sendfile(m_fd, fd, &pos, n);
+        if (res > 0)
+        {
+          left -= static_cast<uint64_t>(res);
+          continue;
+        }
+        if (res == 0)
+        {
+          throw std::runtime_error("Could not read payload");
+        }
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        if (copy_range && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+        {
+          copy_range = false;
+          continue;
+        }
+        if (errno != EINVAL && errno != ENOSYS)
+        {
+          throw std::runtime_error("Could not write " + m_path.string());
+        }
+        break;
+      }
+#  endif
+      std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(left, file_write_chunk_size)));
+      while (left)
+      {
+        const auto n = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+        const auto res = ::pread(fd, buffer.data(), n, pos);
+        if (res < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (res <= 0)
+        {
+          throw std::runtime_error("Could not read payload");
+        }
+        write(buffer.data(), static_cast<size_t>(res));
+        pos += res;
+        left -= static_cast<uint64_t>(res);
+      }
+    }
+
+    void FileWriter::write(const uint8_t* data, size_t length)
+    {
+      while (length)
+      {
+        const auto res = ::write(m_fd, data, length);
+        if (res < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          throw std::runtime_error("Could not write " + m_path.string());
+        }
+        data += res;
+        length -= static_cast<size_t>(res);
+      }
+    }
+
+    void FileWriter::close()
+    {
+      const int fd = m_fd;
+      m_fd = -1;
+      if (::close(fd) != 0)
+      {
+        throw std::runtime_error("Could not write " + m_path.string());
+      }
+    }
+
+    void copyRange(int fd, uint64_t from, uint64_t to, uint64_t length)
+    {
+      auto src = static_cast<off_t>(from);
+      auto dst = static_cast<off_t>(to);
+      auto left = length;
+#  if defined(__linux__)
+      // Ranges within one file must not overlap, so each copy is limited to the distance moved.
+      // Short moves down are left to the chunked copy below, which needs far fewer calls.
+      const auto distance = from > to ? from - to : to - from;
+      while (left && (to > from || distance >= file_move_chunk_size))
+      {
+        const auto n = static_cast<size_t>(std::min<uint64_t>({left, distance, 1 << 30}));
+        const auto res = ::copy_file_range(fd, &src, fd, &dst, n, 0);
+        if (res > 0)
+        {
+          left -= static_cast<uint64_t>(res);
+          continue;
+        }
+        if (res == 0)
+        {
+          throw std::runtime_error("Could not read payload");
+        }
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)
+        {
+          throw std::runtime_error("Could not copy payload");
+        }
+        break;
+      }
+#  endif
+      // Reading each chunk before writing it is safe when the target lies below the source.
+      std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(left, file_move_chunk_size)));
+      while (left)
+      {
+        const auto n = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+        const auto res = ::pread(fd, buffer.data(), n, src);
+        if (res < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if (res <= 0)
+        {
+          throw std::runtime_error("Could not read payload");
+        }
+        for (ssize_t done = 0; done < res;)
+        {
+          const auto w = ::pwrite(fd, buffer.data() + done, static_cast<size_t>(res - done), dst + done);
+          if (w < 0 && errno == EINTR)
+          {
+            continue;
+          }
+          if (w <= 0)
+          {
+            throw std::runtime_error("Could not copy payload");
+          }
+          done += w;
+        }
+        src += res;
+        dst += res;
+        left -= static_cast<uint64_t>(res);
+      }
+    }
+#endif
+
+    AlignedBuffer::AlignedBuffer(size_t size) : m_data{}, m_size{size}
+    {
+#if defined(_WIN32)
+      m_data = static_cast<uint8_t*>(_aligned_malloc(size, file_write_alignment));
+#else
+      void* data = nullptr;
+      if (::posix_memalign(&data, file_write_alignment, size) == 0)
+      {
+        m_data = static_cast<uint8_t*>(data);
+      }
+#endif
+      if (!m_data)
+      {
+        throw std::bad_alloc();
+      }
+    }
+
+    AlignedBuffer::~AlignedBuffer()
+    {
+#if defined(_WIN32)
+      _aligned_free(m_data);
+#else
+      std::free(m_data);
+#endif
+    }
+  } // namespace detail
+} // namespace cppzip
@@ -0,0 +1,208 @@
+/**
+ * \file inflate_index.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <boost/endian/conversion.hpp>
+#include <cstring>
+#include <inflate_index.h>
+#include <raw_inflater.h>
+#include <stdexcept>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    namespace
+    {
+      constexpr uint32_t index_magic = 0x58495a43; // "CZIX"
+      constexpr uint32_t index_version = 1;
+
+      template<typename T>
+      void put(std::ostream& out, T t)
+      {
+        const T tmp = boost::endian::native_to_little(t);
+        out.write(reinterpret_cast<const char*>(&tmp), sizeof(T));
+      }
+
+      template<typename T>
+      bool get(std::istream& in, T& t)
+      {
+        T tmp;
+        if (!in.read(reinterpret_cast<char*>(&tmp), sizeof(T)))
+        {
+          return false;
+        }
+        t = boost::endian::little_to_native(tmp);
+        return true;
+      }
+    } // namespace
+
+    auto InflateIndex::build(const ReadAt_fn& read, uint64_t compressed_size, uint64_t spacing) -> InflateIndex
+    {
+      InflateIndex index;
+      index.m_compressed_size = compressed_size;
+      // The start of the stream needs neither bits nor a window.
+      index.m_points.push_back({0, 0, 0, {}});
+      RawInflater inflater(read, compressed_size, 0);
+      auto& strm = inflater.strm;
+      std::vector<uint8_t> window(inflate_window_size);
+      uint64_t totin = 0;
+      uint64_t totout = 0;
+      uint64_t last = 0;
+      int ret = Z_OK;
+      do
+      {
+        if (!strm.avail_out)
+        {
+          strm.avail_out = static_cast<uInt>(window.size());
+          strm.next_out = window.data();
+        }
+        if (!strm.avail_in)
+        {
+          inflater.fill();
+        }
+        totin += strm.avail_in;
+        totout += strm.avail_out;
+        ret = inflater.step(Z_BLOCK);
+        totin -= strm.avail_in;
+        totout -= strm.avail_out;
+        if (ret == Z_STREAM_END)
+        {
+          break;
+        }
+        // At the end of a block header which is not the last one.
+        if ((strm.data_type & 128) && !(strm.data_type & 64) && totout - last > spacing)
+        {
+          AccessPoint point{totout, totin, strm.data_type & 7, std::vector<uint8_t>(inflate_window_size)};
+          // The window is a ring buffer, unroll it so the oldest byte comes first.
+          const size_t left = strm.avail_out;
+          std::memcpy(point.window.data(), window.data() + window.size() - left, left);
+          std::memcpy(point.window.data() + left, window.data(), window.size() - left);
+          index.m_points.push_back(std::move(point));
+          last = totout;
+        }
+      } while (ret != Z_STREAM_END);
+      return index;
+    }
+
+    auto InflateIndex::extract(const ReadAt_fn& read, uint64_t offset, uint8_t* buffer, size_t length) const -> size_t
+    {
+      if (m_points.empty() || !length)
+      {
+        return 0;
+      }
+      auto here = std::upper_bound(m_points.begin(), m_points.end(), offset,
+                                   [](uint64_t o, const AccessPoint& p) { return o < p.out; });
+      --here;
+
+      RawInflater inflater(read, m_compressed_size, here->in);
+      auto& strm = inflater.strm;
+      if (here->bits)
+      {
+        uint8_t ch;
+        if (read(here->in - 1, &ch, 1) != 1)
+        {
+          throw std::runtime_error("Could not read payload");
+        }
+        inflatePrime(&strm, here->bits, ch >> (8 - here->bits));
+      }
+      if (!here->window.empty())
+      {
+        inflateSetDictionary(&strm, here->window.data(), static_cast<uInt>(here->window.size()));
+      }
+
+      std::vector<uint8_t> discard(inflate_window_size);
+      uint64_t skip = offset - here->out;
+      int ret = Z_OK;
+      while (skip && ret != Z_STREAM_END)
+      {
+        const auto n = static_cast<uInt>(std::min<uint64_t>(skip, discard.size()));
+        strm.next_out = discard.data();
+        strm.avail_out = n;
+        while (strm.avail_out && ret != Z_STREAM_END)
+        {
+          ret = inflater.step(Z_NO_FLUSH);
+        }
+        skip -= n - strm.avail_out;
+      }
+      if (ret == Z_STREAM_END)
+      {
+        return 0;
+      }
+      strm.next_out = buffer;
+      strm.avail_out = static_cast<uInt>(length);
+      while (strm.avail_out && ret != Z_STREAM_END)
+      {
+        ret = inflater.step(Z_NO_FLUSH);
+      }
+      return length - strm.avail_out;
+    }
+
+    void InflateIndex::save(std::ostream& out, uint32_t crc32, uint64_t compressed_size) const
+    {
+      put(out, index_magic);
+      put(out, index_version);
+      put(out, crc32);
+      put(out, compressed_size);
+      put(out, static_cast<uint64_t>(m_points.size()));
+      for (const auto& p : m_points)
+      {
+        put(out, p.out);
+        put(out, p.in);
+        put(out, static_cast<uint8_t>(p.bits));
+        put(out, static_cast<uint32_t>(p.window.size()));
+        out.write(reinterpret_cast<const char*>(p.window.data()), p.window.size());
+      }
+      if (!out)
+      {
+        throw std::runtime_error("Could not write index");
+      }
+    }
+
+    bool InflateIndex::load(std::istream& in, uint32_t crc32, uint64_t compressed_size)
+    {
+      uint32_t magic{}, version{}, crc{};
+      uint64_t size{}, count{};
+      if (!get(in, magic) || !get(in, version) || !get(in, crc) || !get(in, size) || !get(in, count) ||
+          magic != index_magic || version != index_version || crc != crc32 || size != compressed_size || !count)
+      {
+        return false;
+      }
+      std::vector<AccessPoint> points;
+      for (uint64_t i = 0; i < count; ++i)
+      {
+        AccessPoint p{};
+        uint8_t bits{};
+        uint32_t window{};
+        if (!get(in, p.out) || !get(in, p.in) || !get(in, bits) || !get(in, window) || bits > 7 ||
+            p.in > compressed_size || (bits && !p.in))
+        {
+          return false;
+        }
+        // extract relies on the first point being the start of the stream, and on every later
+        // point carrying a window and lying strictly behind the one before.
+        const bool valid = points.empty()
+                               ? p.out == 0 && p.in == 0 && window == 0
+                               : p.out > points.back().out && p.in > points.back().in && window == inflate_window_size;
+        if (!valid)
+        {
+          return false;
+        }
+        p.bits = bits;
+        p.window.resize(window);
+        if (!in.read(reinterpret_cast<char*>(p.window.data()), window))
+        {
+          return false;
+        }
+        points.push_back(std::move(p));
+      }
+      m_compressed_size = compressed_size;
+      m_points = std::move(points);
+      return true;
+    }
+  } // namespace detail
+} // namespace cppzip
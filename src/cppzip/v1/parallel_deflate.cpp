@@ -0,0 +1,172 @@
+/**
+ * \file parallel_deflate.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <codec_pool.h>
+#include <deque>
+#include <helper.h>
+#include <parallel_deflate.h>
+#include <stdexcept>
+#include <thread_pool.h>
+#include <zlib.h>
+
+namespace cppzip
+{
+  namespace detail
+  {
+    namespace
+    {
+      constexpr size_t dictionary_size = 32768;
+      constexpr size_t stream_chunk_size = 256 << 10;
+
+      /**
+       * zlib takes 32 bit lengths and the dictionary has to fit into the previous block.
+       */
+      auto clampBlockSize(size_t block_size) -> size_t
+      {
+        return std::min<size_t>(std::max(block_size, dictionary_size), 1u << 30);
+      }
+
+      struct Block
+      {
+        std::vector<uint8_t> data;
+        uint32_t crc32;
+      };
+
+      auto deflateBlock(const uint8_t* begin,
+                        size_t length,
+                        const uint8_t* dict,
+                        size_t dict_length,
+                        int level,
+                        bool last) -> Block
+      {
+        const auto deflater = acquireDeflater(level);
+        auto& strm = deflater->strm;
+        if (dict_length && deflateSetDictionary(&strm, dict, static_cast<uInt>(dict_length)) != Z_OK)
+        {
+          throw std::runtime_error("Could not set deflate dictionary");
+        }
+        // Room for the sync flush marker on top of the bound of the block.
+        Block block;
+        block.data.resize(deflateBound(&strm, static_cast<uLong>(length)) + 16);
+        strm.next_in = const_cast<Bytef*>(begin);
+        strm.avail_in = static_cast<uInt>(length);
+        strm.next_out = block.data.data();
+        strm.avail_out = static_cast<uInt>(block.data.size());
+        const int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (ret != (last ? Z_STREAM_END : Z_OK) || strm.avail_in)
+        {
+          throw std::runtime_error("Could not compress block");
+        }
+        block.data.resize(block.data.size() - strm.avail_out);
+        block.crc32 = static_cast<uint32_t>(crc32(0L, begin, static_cast<uInt>(length)));
+        return block;
+      }
+    } // namespace
+
+    auto parallelDeflate(const uint8_t* data, size_t length, int level, size_t block_size, unsigned threads)
+        -> DeflateResult
+    {
+      DeflateResult result{{}, 0};
+      result.crc32 = parallelDeflate(data, length, level, block_size, threads, [&result](const uint8_t* b, size_t n) {
+        result.data.insert(result.data.end(), b, b + n);
+      });
+      return result;
+    }
+
+    auto parallelDeflate(const uint8_t* data,
+                         size_t length,
+                         int level,
+                         size_t block_size,
+                         unsigned threads,
+                         const DeflateSink_fn& sink) -> uint32_t
+    {
+      block_size = clampBlockSize(block_size);
+      const size_t count = std::max<size_t>((length + block_size - 1) / block_size, 1);
+
+      const size_t workers = std::min<size_t>(threads ? threads : ThreadPool::defaultConcurrency(), count);
+      ThreadPool pool(static_cast<unsigned>(workers));
+      std::deque<std::future<Block>> blocks;
+      size_t submitted = 0;
+      uint32_t crc = 0;
+      for (size_t i = 0; i < count; ++i)
+      {
+        // Two blocks per worker stay queued, so the workers are busy while the sink writes.
+        for (; submitted < count && submitted < i + 2 * workers; ++submitted)
+        {
+          const size_t offset = submitted * block_size;
+          const size_t n = std::min(block_size, length - offset);
+          const size_t dict = std::min(offset, dictionary_size);
+          const bool last = submitted + 1 == count;
+          blocks.push_back(pool.submit([data, offset, n, dict, level, last] {
+            return deflateBlock(data + offset, n, data + offset - dict, dict, level, last);
+          }));
+        }
+        const auto block = blocks.front().get();
+        blocks.pop_front();
+        const size_t n = std::min(block_size, length - i * block_size);
+        sink(block.data.data(), block.data.size());
+        crc = i ? static_cast<uint32_t>(crc32_combine(crc, block.crc32, static_cast<z_off_t>(n))) : block.crc32;
+      }
+      return crc;
+    }
+
+    auto deflatePayload(const uint8_t* data, size_t length, int level, size_t block_size, unsigned threads)
+        -> DeflateResult
+    {
+      if (threads != 1 && length > block_size)
+      {
+        return parallelDeflate(data, length, level, block_size, threads);
+      }
+      return {deflateRaw(data, length, level), getCrc32(data, length)};
+    }
+
+    auto deflatePayload(const uint8_t* data,
+                        size_t length,
+                        int level,
+                        size_t block_size,
+                        unsigned threads,
+                        const DeflateSink_fn& sink) -> uint32_t
+    {
+      if (threads != 1 && length > block_size)
+      {
+        return parallelDeflate(data, length, level, block_size, threads, sink);
+      }
+      const auto deflater = acquireDeflater(level);
+      auto& strm = deflater->strm;
+      std::vector<uint8_t> buffer(stream_chunk_size);
+      strm.next_in = const_cast<Bytef*>(data);
+      size_t left = length;
+      int ret = Z_OK;
+      while (ret != Z_STREAM_END)
+      {
+        const auto chunk = static_cast<uInt>(std::min<size_t>(left, stream_chunk_size));
+        strm.avail_in = chunk;
+        strm.next_out = buffer.data();
+        strm.avail_out = static_cast<uInt>(buffer.size());
+        ret = deflate(&strm, chunk == left ? Z_FINISH : Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END)
+        {
+          throw std::runtime_error("Could not compress data");
+        }
+        left -= chunk - strm.avail_in;
+        if (strm.avail_out != buffer.size())
+        {
+          sink(buffer.data(), buffer.size() - strm.avail_out);
+        }
+      }
+      return getCrc32(data, length);
+    }
+
+    auto deflatePayloadBound(uint64_t length, size_t block_size) -> uint64_t
+    {
+      // compressBound plus the sync flush marker and slack of deflateBlock for every block.
+      const uint64_t blocks = length / clampBlockSize(block_size) + 1;
+      return length + (length >> 12) + (length >> 14) + (length >> 25) + 13 + blocks * 32;
+    }
+  } // namespace detail
+} // namespace cppzip
@@ -0,0 +1,139 @@
+/**
+ * \file staging_file.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <staging_file.h>
+#include <stdexcept>
+#include <vector>
+
+#if !defined(_WIN32)
+#  include <cerrno>
+#  include <cstdlib>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace cppzip
+{
+  namespace detail
+  {
+#if defined(_WIN32)
+    StagingFile::StagingFile(const boost::filesystem::path& directory)
+      : m_path{directory / boost::filesystem::unique_path("cppzip-%%%%-%%%%-%%%%")},
+        m_file{m_path.wstring(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc}
+    {
+      if (!m_file)
+      {
+        throw std::runtime_error("Could not create staging file");
+      }
+    }
+
+    StagingFile::~StagingFile()
+    {
+      m_file.close();
+      boost::system::error_code ec;
+      boost::filesystem::remove(m_path, ec);
+    }
+
+    void StagingFile::writeAt(uint64_t offset, const uint8_t* data, size_t length)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_file.seekp(static_cast<std::streamoff>(offset));
+      if (!m_file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length)))
+      {
+        throw std::runtime_error("Could not write staging file");
+      }
+    }
+
+    auto StagingFile::readAt(uint64_t offset, uint8_t* buffer, size_t length) const -> size_t
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_file.clear();
+      m_file.seekg(static_cast<std::streamoff>(offset));
+      m_file.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(length));
+      return static_cast<size_t>(m_file.gcount());
+    }
+#else
+    StagingFile::StagingFile(const boost::filesystem::path& directory)
+    {
+#  if defined(O_TMPFILE)
+      m_fd = ::open(directory.string().c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#  endif
+      if (m_fd < 0)
+      {
+        // Without O_TMPFILE the file is unlinked right away, which has the same effect.
+        auto name = (directory / "cppzip-XXXXXX").string();
+        std::vector<char> buffer(name.begin(), name.end());
+        buffer.push_back('\0');
+        m_fd = ::mkstemp(buffer.data());
+        if (m_fd < 0)
+        {
+          throw std::runtime_error("Could not create staging file");
+        }
+        ::unlink(buffer.data());
+        ::fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+      }
+    }
+
+    StagingFile::~StagingFile()
+    {
+      ::close(m_fd);
+    }
+
+    void StagingFile::writeAt(uint64_t offset, const uint8_t* data, size_t length)
+    {
+      auto pos = offset;
+      while (length)
+      {
+        const auto res = ::pwrite(m_fd, data, length, static_cast<off_t>(pos));
+        if (res < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          throw std::runtime_error("Could not write staging file");
+        }
+        data += res;
+        pos += static_cast<uint64_t>(res);
+        length -= static_cast<size_t>(res);
+      }
+    }
+
+    auto StagingFile::readAt(uint64_t offset, uint8_t* buffer, size_t length) const -> size_t
+    {
+      for (;;)
+      {
+        const auto res = ::pread(m_fd, buffer, length, static_cast<off_t>(offset));
+        if (res >= 0)
+        {
+          return static_cast<size_t>(res);
+        }
+        if (errno != EINTR)
+        {
+          throw std::runtime_error("Could not read staging file");
+        }
+      }
+    }
+#endif
+
+    auto StagingFile::reserve(uint64_t length) -> uint64_t
+    {
+      // Only the range is taken under the lock, writers of different ranges do not wait.
+      std::lock_guard<std::mutex> lock(m_mutex);
+      const auto offset = m_size;
+      m_size += length;
+      return offset;
+    }
+
+    auto StagingFile::append(const uint8_t* data, size_t length) -> uint64_t
+    {
+      const auto offset = reserve(length);
+      writeAt(offset, data, length);
+      return offset;
+    }
+  } // namespace detail
+} // namespace cppzip
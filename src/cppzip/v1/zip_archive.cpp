@@ -5,17 +5,47 @@
 //		Distributed under rhe MIT License.
 //		(See accompanying file LICENSE)
 
+#include <algorithm>
+#include <archive_source.h>
+#include <array>
+#include <async_context.h>
+#include <atomic>
+#include <batch_reader.h>
+#include <cached_source.h>
 #include <boost/fusion/include/accumulate.hpp>
 #include <boost/fusion/include/for_each.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cerrno>
 #include <central_directory_file_header.h>
+#include <compression_cache.h>
 #include <cppzip/v1/zip_archive.h>
 #include <cppzip/v1/zip_entry.h>
+#include <deque>
 #include <digital_signature.h>
 #include <end_of_central_directory_record.h>
+#include <file_writer.h>
+#include <future>
 #include <helper.h>
+#include <iterator>
 #include <local_file_header.h>
+#include <mutex>
+#include <numeric>
+#include <output_buffer.h>
+#include <parallel_deflate.h>
+#include <path_index.h>
+#include <raw_inflater.h>
+#include <sstream>
+#include <staging_file.h>
+#include <thread>
+#include <thread_pool.h>
 #include <zip_functions.h>
 
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
 namespace cppzip
 {
   inline namespace v1
@@ -45,32 +75,22 @@ namespace cppzip
         return hasData ? 8 : 0;
       }
 
-      uint32_t timestamp_to_datetime(time_t dateTime)
+      /**
+       * Returns an offset as a header field. Archives reaching 4 GiB would need zip64, which is
+       * not written.
+       */
+      uint32_t checkedOffset(uint64_t offset)
       {
-        tm timeStruct;
-#if defined(_WIN32)
-        localtime_s(&dateTime, &timeStruct);
-#else
-        struct tm* tmp = localtime(&dateTime);
-        memcpy(&timeStruct, tmp, sizeof(tm));
-#endif
-        uint16_t date = ((timeStruct.tm_year - 80) << 9) + ((timeStruct.tm_mon + 1) << 5) + timeStruct.tm_mday;
-        uint16_t time = (timeStruct.tm_hour << 11) + (timeStruct.tm_min << 5) + (timeStruct.tm_sec >> 1);
-        return (date << 16) | time;
+        if (offset >= std::numeric_limits<uint32_t>::max())
+        {
+          throw std::runtime_error("Archive is too large");
+        }
+        return static_cast<uint32_t>(offset);
       }
 
       uint32_t timestamp_now()
       {
-        tm timeStruct;
-#if defined(_WIN32)
-        localtime_s(nullptr, &timeStruct);
-#else
-        struct tm* tmp = localtime(nullptr);
-        memcpy(&timeStruct, tmp, sizeof(tm));
-#endif
-        uint16_t date = ((timeStruct.tm_year - 80) << 9) + ((timeStruct.tm_mon + 1) << 5) + timeStruct.tm_mday;
-        uint16_t time = (timeStruct.tm_hour << 11) + (timeStruct.tm_min << 5) + (timeStruct.tm_sec >> 1);
-        return (date << 16) | time;
+        return timestampToDosTime(time(nullptr));
       }
 
       boost::filesystem::path makeCheckedPath(const std::string& entryName)
@@ -83,6 +103,117 @@ namespace cppzip
         return path;
       }
 
+      /**
+       * Calls fn with each parent directory of path, ending with '/', and returns the name of
+       * the entry itself.
+       */
+      template<typename F>
+      boost::filesystem::path forEachParent(const boost::filesystem::path& path, F&& fn)
+      {
+        boost::filesystem::path fullpath{};
+        for (const auto& p : path)
+        {
+          fullpath /= p;
+          if (fullpath == path)
+          {
+            break;
+          }
+          fullpath.append("/");
+          fn(fullpath);
+        }
+        return fullpath;
+      }
+
+      /**
+       * Checks what can be checked about a payload compressed elsewhere without inflating it.
+       */
+      void checkPrecompressed(const uint8_t* payload,
+                              uint64_t compressed_size,
+                              uint64_t uncompressed_size,
+                              CompressionMethod method)
+      {
+        detail::checkedSize(compressed_size);
+        detail::checkedSize(uncompressed_size);
+        if (compressed_size && !payload)
+        {
+          throw std::runtime_error("Payload is missing");
+        }
+        switch (method)
+        {
+        case CompressionMethod::no:
+          if (compressed_size != uncompressed_size)
+          {
+            throw std::runtime_error("Sizes of a stored entry differ");
+          }
+          break;
+        case CompressionMethod::defalted:
+          // The first block must not have the reserved type, and deflate shrinks by 1032:1 at most.
+          if (!compressed_size || (payload[0] & 0x06) == 0x06 || uncompressed_size > compressed_size * 1032 + 258)
+          {
+            throw std::runtime_error("Payload is not a deflate stream of the given size");
+          }
+          break;
+        default:
+          throw std::runtime_error("Compression method not supported");
+        }
+      }
+
+      /**
+       * Asks the kernel to start reading a file into the page cache, so the worker reading it
+       * later does not wait for the disk. Errors are left to the actual read.
+       */
+      void readAhead(const boost::filesystem::path& file)
+      {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+        const int fd = ::open(file.string().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+          ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+          ::close(fd);
+        }
+#else
+        (void)file;
+#endif
+      }
+
+      std::vector<uint8_t> readFile(const boost::filesystem::path& file)
+      {
+        std::ifstream fs(
+#ifdef _MSC_VER
+            ToUtf16(file.string())
+#else
+            file.string()
+#endif
+                ,
+            std::ifstream::in | std::ifstream::binary);
+        if (!fs)
+        {
+          throw std::runtime_error("Could not open " + file.string());
+        }
+        fs.seekg(0, std::ios::end);
+        std::vector<uint8_t> content(detail::checkedSize(static_cast<uint64_t>(fs.tellg())));
+        fs.seekg(0, std::ios::beg);
+        fs.read(reinterpret_cast<char*>(content.data()), static_cast<std::streamsize>(content.size()));
+        if (static_cast<size_t>(fs.gcount()) != content.size())
+        {
+          throw std::runtime_error("Could not read " + file.string());
+        }
+        return content;
+      }
+
+      boost::filesystem::path makeExtractPath(const boost::filesystem::path& directory, const std::string& entryName)
+      {
+        const boost::filesystem::path path = makeCheckedPath(entryName);
+        for (const auto& p : path)
+        {
+          if (p == "..")
+          {
+            throw std::runtime_error("Entry leaves the target directory: " + entryName);
+          }
+        }
+        return directory / path;
+      }
+
 #ifdef _MSC_VER
       std::wstring toUtf16(const std::string& utf8)
       {
@@ -91,50 +222,231 @@ namespace cppzip
         return utf16;
       }
 #endif
-      struct EntryCompare final
+      struct PayloadCheck
+      {
+        uint32_t crc32;
+        uint64_t size;
+      };
+
+      /**
+       * Inflates a payload into a discard buffer and returns the CRC and size of its content.
+       */
+      auto checkPayload(const detail::ReadAt_fn& read, uint64_t compressed_size, CompressionMethod method)
+          -> PayloadCheck
       {
-        const std::string& entry;
-        constexpr EntryCompare(const std::string& e) noexcept : entry{e}
+        PayloadCheck result{0, 0};
+        std::vector<uint8_t> buffer(detail::inflate_chunk_size);
+        if (method == CompressionMethod::no)
+        {
+          while (result.size < compressed_size)
+          {
+            const auto want = static_cast<size_t>(std::min<uint64_t>(buffer.size(), compressed_size - result.size));
+            const auto got = read(result.size, buffer.data(), want);
+            if (!got)
+            {
+              throw std::runtime_error("Could not read payload");
+            }
+            result.crc32 = static_cast<uint32_t>(crc32(result.crc32, buffer.data(), static_cast<uInt>(got)));
+            result.size += got;
+          }
+          return result;
+        }
+        if (method != CompressionMethod::defalted)
         {
+          throw std::runtime_error("Compression method not supported");
         }
-
-        bool operator()(const std::shared_ptr<ZipEntry> e) const
+        detail::RawInflater inflater(read, compressed_size, 0);
+        int ret = Z_OK;
+        while (ret != Z_STREAM_END)
         {
-          return entry == e->getEntryName();
+          inflater.strm.next_out = buffer.data();
+          inflater.strm.avail_out = static_cast<uInt>(buffer.size());
+          ret = inflater.step(Z_NO_FLUSH);
+          const auto produced = buffer.size() - inflater.strm.avail_out;
+          result.crc32 = static_cast<uint32_t>(crc32(result.crc32, buffer.data(), static_cast<uInt>(produced)));
+          result.size += produced;
         }
-      };
+        return result;
+      }
 
-      struct FileAccess final
+      /**
+       * Reads a file with positional reads. Opened with OpenMode::Write it can also be
+       * modified in place.
+       */
+      struct FileAccess final : detail::ArchiveSource
       {
-        FileAccess(boost::filesystem::path p, ZipArchive::OpenMode mode)
-          : m_file(
-#ifdef _MSC_VER
-                ToUtf16(p.string())
-#else
-                p.string(),
-#endif
-                            mode != ZipArchive::OpenMode::ReadOnly
-                    ? (std::ios::in | std::ios::out | std::ios::binary)
-                    : (std::ios::in | std::ios::binary))
+        FileAccess(boost::filesystem::path p, ZipArchive::OpenMode mode) : m_path{std::move(p)}
         {
+#if defined(_WIN32)
+          m_file.open(
+#  ifdef _MSC_VER
+              ToUtf16(m_path.string()),
+#  else
+              m_path.string(),
+#  endif
+              mode != ZipArchive::OpenMode::ReadOnly ? (std::ios::in | std::ios::out | std::ios::binary)
+                                                     : (std::ios::in | std::ios::binary));
           if (!m_file)
           {
             throw std::runtime_error("Could not load open file");
           }
+#else
+          m_fd = ::open(m_path.string().c_str(), (mode == ZipArchive::OpenMode::Write ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+          if (m_fd < 0)
+          {
+            throw std::runtime_error("Could not load open file");
+          }
+#endif
+        }
+        FileAccess(const FileAccess&) = delete;
+        FileAccess& operator=(const FileAccess&) = delete;
+
+        ~FileAccess() override
+        {
+#if !defined(_WIN32)
+          ::close(m_fd);
+#endif
         }
 
-        std::streamsize read(std::streamsize pos, std::ios::seekdir sd, uint8_t* b, size_t l) const
+        auto readAt(uint64_t offset, uint8_t* b, size_t l) const -> size_t override
         {
-          m_file.seekg(pos, sd);
+#if !defined(_WIN32)
+          size_t done = 0;
+          while (done < l)
+          {
+            const auto res = ::pread(m_fd, b + done, l - done, static_cast<off_t>(offset + done));
+            if (res < 0 && errno == EINTR)
+            {
+              continue;
+            }
+            if (res < 0)
+            {
+              throw std::runtime_error("Could not read file");
+            }
+            if (res == 0)
+            {
+              break;
+            }
+            done += static_cast<size_t>(res);
+          }
+          return done;
+#else
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_file.clear();
+          m_file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
           m_file.read(reinterpret_cast<char*>(b), l);
-          return m_file.gcount();
+          return static_cast<size_t>(m_file.gcount());
+#endif
+        }
+
+        auto size() const -> uint64_t override
+        {
+#if !defined(_WIN32)
+          struct stat st;
+          if (::fstat(m_fd, &st) != 0)
+          {
+            throw std::runtime_error("Could not read file");
+          }
+          return static_cast<uint64_t>(st.st_size);
+#else
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_file.clear();
+          m_file.seekg(0, std::ios::end);
+          return static_cast<uint64_t>(m_file.tellg());
+#endif
+        }
+
+        void writeAt(uint64_t offset, const uint8_t* b, size_t l)
+        {
+#if !defined(_WIN32)
+          while (l)
+          {
+            const auto res = ::pwrite(m_fd, b, l, static_cast<off_t>(offset));
+            if (res < 0 && errno == EINTR)
+            {
+              continue;
+            }
+            if (res <= 0)
+            {
+              throw std::runtime_error("Could not write file");
+            }
+            b += res;
+            offset += static_cast<uint64_t>(res);
+            l -= static_cast<size_t>(res);
+          }
+#else
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_file.clear();
+          m_file.seekp(static_cast<std::streamoff>(offset), std::ios::beg);
+          if (!m_file.write(reinterpret_cast<const char*>(b), l).flush())
+          {
+            throw std::runtime_error("Could not write file");
+          }
+#endif
+        }
+
+        /**
+         * Copies a range of the file. The ranges may only overlap if to is the lower one.
+         */
+        void copyRange(uint64_t from, uint64_t to, uint64_t length)
+        {
+#if !defined(_WIN32)
+          detail::copyRange(m_fd, from, to, length);
+#else
+          std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(length, detail::file_move_chunk_size)));
+          for (uint64_t done = 0; done < length;)
+          {
+            const auto n = static_cast<size_t>(std::min<uint64_t>(length - done, buffer.size()));
+            if (readAt(from + done, buffer.data(), n) != n)
+            {
+              throw std::runtime_error("Could not read payload");
+            }
+            writeAt(to + done, buffer.data(), n);
+            done += n;
+          }
+#endif
+        }
+
+        void resize(uint64_t size)
+        {
+#if !defined(_WIN32)
+          if (::ftruncate(m_fd, static_cast<off_t>(size)) != 0)
+          {
+            throw std::runtime_error("Could not resize file");
+          }
+#else
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_file.flush();
+          boost::filesystem::resize_file(m_path, size);
+#endif
         }
+
+        int nativeHandle() const noexcept override
+        {
+          return m_fd;
+        }
+
+        auto data() const noexcept -> const uint8_t* override
+        {
+          return nullptr;
+        }
+
+        boost::filesystem::path m_path;
+        int m_fd = -1;
+#if defined(_WIN32)
         mutable std::fstream m_file;
+        mutable std::mutex m_mutex;
+#endif
       };
 
-      struct MemoryAccess final
+      /**
+       * Reads from a contiguous block of memory: a copy of the caller's data, a mapped file
+       * or memory borrowed from the caller. owner keeps the block alive.
+       */
+      struct MemoryAccess final : detail::ArchiveSource
       {
-        MemoryAccess(const std::vector<uint8_t>& d, ZipArchive::OpenMode mode) : m_data(d), m_offset{}
+        MemoryAccess(std::shared_ptr<const void> owner, const uint8_t* data, size_t size, ZipArchive::OpenMode mode)
+          : m_owner{std::move(owner)}, m_data{data}, m_size{size}
         {
           if (mode == ZipArchive::OpenMode::Write)
           {
@@ -142,48 +454,110 @@ namespace cppzip
           }
         }
 
-        std::streamsize read(std::streamsize pos, std::ios::seekdir sd, uint8_t* b, size_t l) const
+        auto readAt(uint64_t offset, uint8_t* b, size_t l) const -> size_t override
         {
-          switch (sd)
-          {
-          case std::ios::cur:
-            m_offset += pos;
-            break;
-          case std::ios::beg:
-            m_offset = pos;
-            break;
-          case std::ios::end:
-            m_offset = m_data.size() + pos;
-            break;
-          default:
-            break;
-          }
-          if (m_offset > m_data.size())
+          if (offset > m_size)
           {
             throw std::runtime_error("Out of bounds");
           }
-          memcpy(b, m_data.data() + m_offset, l);
+          l = std::min<size_t>(l, m_size - offset);
+          memcpy(b, m_data + offset, l);
           return l;
         }
-        const std::vector<uint8_t> m_data;
-        mutable size_t m_offset;
+
+        auto size() const -> uint64_t override
+        {
+          return m_size;
+        }
+
+        int nativeHandle() const noexcept override
+        {
+          return -1;
+        }
+
+        auto data() const noexcept -> const uint8_t* override
+        {
+          return m_data;
+        }
+
+        const std::shared_ptr<const void> m_owner;
+        const uint8_t* const m_data;
+        const size_t m_size;
       };
 
-      struct ReadFromArray final
+      constexpr size_t pending_shards = 16;
+
+      /**
+       * Entries finished by concurrent producers. Each thread appends to one of a few shards,
+       * so producers rarely wait for each other.
+       */
+      class PendingEntries final
       {
-        const uint8_t* buffer;
-        ReadFromArray(const uint8_t* a) noexcept : buffer(a)
+      public:
+        void push(ZipEntryPtr entry)
         {
+          const auto sequence = m_sequence.fetch_add(1, std::memory_order_relaxed);
+          auto name = entry->getEntryName();
+          auto& shard = m_shards[std::hash<std::thread::id>{}(std::this_thread::get_id()) % pending_shards];
+          std::lock_guard<std::mutex> lock(shard.mutex);
+          shard.items.push_back({sequence, std::move(name), std::move(entry)});
         }
-        template<typename T>
-        void operator()(T& t)
+
+        /**
+         * Removes the queued entries and returns them in name order, entries of the same name
+         * in the order they were queued.
+         */
+        auto take() -> std::vector<ZipEntryPtr>
         {
-          T tmp;
-          memcpy(&tmp, buffer, sizeof(T));
-          t = boost::endian::little_to_native(tmp);
-          buffer += sizeof(T);
+          std::vector<Item> items;
+          for (auto& shard : m_shards)
+          {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            std::move(shard.items.begin(), shard.items.end(), std::back_inserter(items));
+            shard.items.clear();
+          }
+          std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+            return a.name < b.name || (a.name == b.name && a.sequence < b.sequence);
+          });
+          std::vector<ZipEntryPtr> result;
+          result.reserve(items.size());
+          for (auto& item : items)
+          {
+            result.push_back(std::move(item.entry));
+          }
+          return result;
         }
+
+      private:
+        struct Item
+        {
+          uint64_t sequence;
+          std::string name;
+          ZipEntryPtr entry;
+        };
+
+        struct Shard
+        {
+          std::mutex mutex;
+          std::vector<Item> items;
+        };
+
+        std::array<Shard, pending_shards> m_shards;
+        std::atomic<uint64_t> m_sequence{0};
       };
+
+      auto makeMemoryAccess(const std::vector<uint8_t>& data, ZipArchive::OpenMode mode)
+      {
+        auto copy = std::make_shared<const std::vector<uint8_t>>(data);
+        return std::make_shared<MemoryAccess>(copy, copy->data(), copy->size(), mode);
+      }
+
+      auto makeMappedAccess(const boost::filesystem::path& path)
+      {
+        auto file = std::make_shared<boost::iostreams::mapped_file_source>(path.string());
+        return std::make_shared<MemoryAccess>(file, reinterpret_cast<const uint8_t*>(file->data()), file->size(),
+                                              ZipArchive::OpenMode::ReadOnly);
+      }
     } // namespace
 
     struct ZipArchive::pimpl
@@ -192,35 +566,93 @@ namespace cppzip
       pimpl() : m_end_of_central_directory_record{end_of_central_directory_signature, {}, {}, {}, {}, {}, {}, {}, {}}
       {
       }
-      pimpl(boost::filesystem::path path, OpenMode mode)
-        : m_path{std::move(path)}
-        , m_read([access = std::make_shared<FileAccess>(m_path, mode)](
-                     std::streamsize p, std::ios::seekdir o, uint8_t* b, size_t l) { return access->read(p, o, b, l); })
+      pimpl(boost::filesystem::path path, OpenMode mode) : pimpl()
+      {
+        m_path = std::move(path);
+        if (mode == OpenMode::Mapped)
+        {
+          const auto access = makeMappedAccess(m_path);
+          attach(access);
+          load(*access);
+        }
+        else
+        {
+          const auto file = std::make_shared<FileAccess>(m_path, mode);
+          if (mode == OpenMode::Write)
+          {
+            m_file = file;
+          }
+          attach(file);
+          load(*file);
+        }
+      }
+
+      pimpl(const std::vector<uint8_t>& data, OpenMode mode) : pimpl()
+      {
+        const auto access = makeMemoryAccess(data, mode);
+        attach(access);
+        if (mode != OpenMode::New)
+        {
+          load(*access);
+        }
+      }
+
+      pimpl(const uint8_t* data, size_t size) : pimpl()
+      {
+        const auto access = std::make_shared<MemoryAccess>(nullptr, data, size, OpenMode::ReadOnly);
+        attach(access);
+        load(*access);
+      }
+
+      pimpl(std::shared_ptr<const RandomAccessSource> source, const SourceCacheOptions& options) : pimpl()
+      {
+        const auto access = std::make_shared<detail::CachedSource>(std::move(source), options);
+        attach(access);
+        load(*access);
+      }
+
+      /**
+       * Parses the directory. Instantiated for each access type so its reads are direct calls.
+       */
+      template<typename Access>
+      void load(const Access& access)
       {
-        init_end_of_central_directory();
-        init_central_directory();
-        load_entries();
+        init_end_of_central_directory(access);
+        init_central_directory(access);
+        load_entries(access);
       }
 
-      pimpl(const std::vector<uint8_t>& data, OpenMode mode)
-        : m_read([access = std::make_shared<MemoryAccess>(data, mode)](
-                     std::streamsize p, std::ios::seekdir o, uint8_t* b, size_t l) { return access->read(p, o, b, l); })
+      void attach(detail::ArchiveSourcePtr storage)
       {
+        m_source = detail::ReadSource{storage->nativeHandle(), [storage](uint64_t o, uint8_t* b, size_t l) {
+                                        return storage->readAt(o, b, l);
+                                      }};
+        m_storage = std::move(storage);
       }
 
-      void init_end_of_central_directory()
+      template<typename Access>
+      void init_end_of_central_directory(const Access& access)
       {
-        uint8_t rec[end_of_central_directory_size];
-        std::streamsize seek_pos = -std::streamsize(end_of_central_directory_size);
-        while (const auto res = m_read(seek_pos, std::ios::end, rec, end_of_central_directory_size))
+        // The record is followed by at most a maximal comment, so one read of the tail finds it.
+        const auto size = access.size();
+        const auto tail_size = static_cast<size_t>(
+            std::min<uint64_t>(size, end_of_central_directory_size + std::numeric_limits<uint16_t>::max()));
+        std::vector<uint8_t> tail(tail_size);
+        if (tail_size < end_of_central_directory_size ||
+            access.readAt(size - tail_size, tail.data(), tail_size) != tail_size)
+        {
+          throw std::runtime_error("Could not load end of central directory");
+        }
+        for (auto pos = tail_size - end_of_central_directory_size + 1; pos-- > 0;)
         {
-          boost::fusion::for_each(m_end_of_central_directory_record, ReadFromArray(rec));
-          if (res < static_cast<long long>(end_of_central_directory_size) ||
-              m_end_of_central_directory_record.signature == end_of_central_directory_signature)
+          boost::fusion::for_each(m_end_of_central_directory_record, detail::ReadFromArray(tail.data() + pos));
+          if (m_end_of_central_directory_record.signature == end_of_central_directory_signature)
           {
+            const auto* comment = tail.data() + pos + end_of_central_directory_size;
+            m_end_of_central_directory_record.zip_comment.assign(reinterpret_cast<const char*>(comment),
+                                                                 tail.data() + tail_size - comment);
             break;
           }
-          --seek_pos;
         }
         if (m_end_of_central_directory_record.signature != end_of_central_directory_signature)
         {
@@ -230,24 +662,15 @@ namespace cppzip
         {
           throw std::runtime_error("Multi file zip not implemented");
         }
-        if (const std::streamsize new_pos = seek_pos + end_of_central_directory_size)
-        {
-          m_end_of_central_directory_record.zip_comment.resize((-new_pos) + 1);
-          const auto res =
-              m_read(new_pos, std::ios::end, (uint8_t*)&m_end_of_central_directory_record.zip_comment[0], -new_pos);
-          if (res != -new_pos)
-          {
-            throw std::runtime_error("Multi file zip not implemented");
-          }
-        }
       }
 
-      void init_central_directory()
+      template<typename Access>
+      void init_central_directory(const Access& access)
       {
         std::vector<uint8_t> central_directory(m_end_of_central_directory_record.central_directory_size);
-        const auto res = m_read(m_end_of_central_directory_record.offset, std::ios::beg, central_directory.data(),
-                                central_directory.size());
-        if (static_cast<size_t>(res) != central_directory.size())
+        const auto res =
+            access.readAt(m_end_of_central_directory_record.offset, central_directory.data(), central_directory.size());
+        if (res != central_directory.size())
         {
           throw std::runtime_error("Could not load central directory");
         }
@@ -257,7 +680,7 @@ namespace cppzip
         for (auto i = 0; i < m_end_of_central_directory_record.total_entries; ++i)
         {
           CentralDirectoryFileHeader central_directory_file_header;
-          boost::fusion::for_each(central_directory_file_header, ReadFromArray(pos));
+          boost::fusion::for_each(central_directory_file_header, detail::ReadFromArray(pos));
           if (central_directory_file_header.signature != central_directory_file_header_signature)
           {
             throw std::runtime_error("Wrong central directory signature");
@@ -285,7 +708,7 @@ namespace cppzip
         }
         if (pos + digital_signature_size < end)
         {
-          boost::fusion::for_each(m_digital_signature, ReadFromArray(pos));
+          boost::fusion::for_each(m_digital_signature, detail::ReadFromArray(pos));
           pos += digital_signature_size;
           if (m_digital_signature.size)
           {
@@ -299,42 +722,50 @@ namespace cppzip
         }
       }
 
-      void load_entries()
+      template<typename Access>
+      void load_entries(const Access& access)
       {
+        std::vector<uint8_t> buffer(local_file_header_size);
         for (const auto& file_header : m_central_directory_file_headers)
         {
-          std::vector<uint8_t> loc(local_file_header_size);
-          const auto res = m_read(file_header.offset_of_local_header, std::ios::beg, loc.data(), loc.size());
-          if (static_cast<size_t>(res) != loc.size())
+          if (access.readAt(file_header.offset_of_local_header, buffer.data(), local_file_header_size) !=
+              local_file_header_size)
           {
             throw std::runtime_error("Could not local file header");
           }
           LocalFileHeader local_file_header;
-          boost::fusion::for_each(local_file_header, ReadFromArray(loc.data()));
-          if (local_file_header.file_name_length)
+          boost::fusion::for_each(local_file_header, detail::ReadFromArray(buffer.data()));
+          // The name and the extra field follow the header and are read at once.
+          const size_t variable = local_file_header.file_name_length + local_file_header.extra_field_length;
+          buffer.resize(std::max(buffer.size(), variable));
+          if (access.readAt(file_header.offset_of_local_header + local_file_header_size, buffer.data(), variable) !=
+              variable)
           {
-            local_file_header.file_name.resize(local_file_header.file_name_length);
-            const auto res =
-                m_read(0, std::ios::cur, (uint8_t*)&local_file_header.file_name[0], local_file_header.file_name_length);
-            if (res != local_file_header.file_name_length)
-            {
-              throw std::runtime_error("Could not read file name");
-            }
+            throw std::runtime_error("Could not read file name");
           }
-          if (local_file_header.extra_field_length)
+          local_file_header.file_name.assign(reinterpret_cast<const char*>(buffer.data()),
+                                             local_file_header.file_name_length);
+          local_file_header.extra_field.assign(buffer.data() + local_file_header.file_name_length,
+                                               buffer.data() + variable);
+          if (local_file_header.flags & 0x08)
           {
-            local_file_header.extra_field.resize(local_file_header.extra_field_length);
-            const auto res =
-                m_read(0, std::ios::cur, local_file_header.extra_field.data(), local_file_header.extra_field.size());
-            if (static_cast<size_t>(res) != local_file_header.extra_field.size())
-            {
-              throw std::runtime_error("Could not read extra data");
-            }
+            // The sizes follow the payload in a data descriptor, the central record has them too.
+            local_file_header.crc32 = file_header.crc32;
+            local_file_header.compressed_size = file_header.compressed_size;
+            local_file_header.uncompressed_size = file_header.uncompressed_size;
+          }
+          const size_t datapos = file_header.offset_of_local_header + local_file_header_size + variable;
+          // Mapped and borrowed payloads are read in place, so they must lie within the archive.
+          const uint64_t payload = std::max(local_file_header.compressed_size, file_header.compressed_size);
+          if (datapos + payload > access.size())
+          {
+            throw std::runtime_error("Payload of " + local_file_header.file_name + " ends beyond the archive");
           }
-          const size_t datapos = file_header.offset_of_local_header + local_file_header_size +
-                                 local_file_header.file_name_length + local_file_header.extra_field_length;
-          m_entries.push_back(std::shared_ptr<ZipEntry>(new ZipEntry(local_file_header, datapos, m_read)));
+          m_entries.push_back(std::shared_ptr<ZipEntry>(new ZipEntry(local_file_header, datapos, m_storage)));
+          m_entries.back()->setAsyncContext(m_async);
+          m_index.insert(m_entries.back()->getEntryName(), m_entries.back());
         }
+        m_loaded_entries = m_entries.size();
       }
 
       auto getPath() const
@@ -344,7 +775,15 @@ namespace cppzip
 
       bool isEncrypted() const noexcept
       {
-        return false;
+        return std::any_of(m_entries.begin(), m_entries.end(), [](const ZipEntryPtr& e) { return e->isEncrypted(); });
+      }
+
+      void setPassword(const std::string& password)
+      {
+        for (const auto& e : m_entries)
+        {
+          e->setPassword(password);
+        }
       }
 
       void setComment(const std::string& comment)
@@ -370,74 +809,369 @@ namespace cppzip
 
       auto hasEntry(const std::string& zipEntryName) const noexcept -> bool
       {
-        return std::find_if(std::begin(m_entries), std::end(m_entries), EntryCompare{zipEntryName}) != m_entries.end();
+        return m_index.find(zipEntryName) != nullptr;
       }
 
       auto getEntry(const std::string& name) const -> ZipEntryPtr
       {
-        const auto iter = std::find_if(std::begin(m_entries), std::end(m_entries), EntryCompare(name));
-        if (iter != std::end(m_entries))
+        if (const auto* entry = m_index.find(name))
         {
-          return *iter;
+          return *entry;
         }
         return {};
       }
 
-      bool renameEntry(const std::string& entry, const std::string& newName) const
+      auto listDirectory(const std::string& directory) const -> std::vector<std::string>
       {
-        return false;
+        return m_index.children(directory);
       }
 
-      auto addFile(const std::string& entryName, const boost::filesystem::path& file)
+      auto walkDirectory(const std::string& directory) const -> std::vector<ZipEntryPtr>
       {
-        boost::filesystem::path path = makeCheckedPath(entryName);
-        if (!boost::filesystem::exists(file))
-        {
-          return false;
-        }
+        std::vector<ZipEntryPtr> result;
+        m_index.walk(directory, [&result](const std::string&, const ZipEntryPtr& e) { result.push_back(e); });
+        return result;
+      }
 
-        std::ifstream fs(
-#ifdef _MSC_VER
-            ToUtf16(file.string())
-#else
-            file.string()
-#endif
-                ,
-            std::ifstream::in | std::ifstream::binary);
+      auto findEntries(const std::string& pattern) const -> std::vector<ZipEntryPtr>
+      {
+        std::vector<ZipEntryPtr> result;
+        m_index.match(pattern, [&result](const std::string&, const ZipEntryPtr& e) { result.push_back(e); });
+        return result;
+      }
 
-        std::vector<uint8_t> content((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
-        return addData(entryName, content.data(), content.size());
+      auto indexOf(const std::string& name) const -> size_t
+      {
+        const auto* entry = m_index.find(name);
+        if (!entry)
+        {
+          return m_entries.size();
+        }
+        return static_cast<size_t>(std::find(m_entries.begin(), m_entries.end(), *entry) - m_entries.begin());
       }
 
-      auto buildEntries(const boost::filesystem::path& path) -> boost::filesystem::path
+      bool renameEntry(const std::string& entry, const std::string& newName)
       {
-        boost::filesystem::path fullpath{};
-        for (const auto& p : path)
+        const auto index = indexOf(entry);
+        if (index == m_entries.size() || hasEntry(newName) || newName.size() > std::numeric_limits<uint16_t>::max())
         {
-          fullpath /= p;
-          if (fullpath == path)
+          return false;
+        }
+        makeCheckedPath(newName);
+        auto& central = m_central_directory_file_headers[index];
+        const auto length = central.file_name_length;
+        central.file_name = newName;
+        central.file_name_length = static_cast<uint16_t>(newName.size());
+        m_entries[index]->setName(newName);
+        m_index.erase(entry);
+        m_index.insert(newName, m_entries[index]);
+        if (m_file && m_entries.size() == m_loaded_entries)
+        {
+          if (newName.size() == length)
           {
-            break;
+            const auto header = serializeLocalHeader(m_entries[index]->localHeader());
+            m_file->writeAt(central.offset_of_local_header, reinterpret_cast<const uint8_t*>(header.data()),
+                            header.size());
           }
-          fullpath.append("/");
-          if (!hasEntry(fullpath.string()))
+          else
           {
-            newEntry(fullpath.string(), nullptr, 0);
+            appendRecord(index);
           }
+          persistDirectory();
         }
-        return fullpath;
+        return true;
       }
 
-      bool addData(const std::string& entryName, const void* data, uint64_t length)
+      static auto serializeLocalHeader(const LocalFileHeader& h) -> std::string
       {
-        boost::filesystem::path path = makeCheckedPath(entryName);
-        boost::filesystem::path fullpath = buildEntries(path);
-        newEntry(fullpath.string(), data, length);
-        return true;
+        std::ostringstream stream;
+        detail::OutputBuffer out(stream);
+        boost::fusion::accumulate(h, size_t(0), detail::WriteToBuffer(out));
+        out.write(h.file_name.data(), h.file_name.size());
+        out.write(h.extra_field.data(), h.extra_field.size());
+        out.flush();
+        return stream.str();
       }
 
-      bool addEntry(const std::string& entryName)
+      /**
+       * Copies the local record of the loaded entry at index with its current name to the end
+       * of the data area, where the central directory is written next. The old record is left
+       * as a gap for compact.
+       */
+      void appendRecord(size_t index)
+      {
+        auto& central = m_central_directory_file_headers[index];
+        const auto& entry = m_entries[index];
+        const uint64_t data = entry->dataOffset();
+        const auto end = recordEnd(index);
+        const uint64_t target = m_end_of_central_directory_record.offset;
+        const auto header = serializeLocalHeader(entry->localHeader());
+        const auto directory = checkedOffset(target + header.size() + end - data);
+        m_file->writeAt(target, reinterpret_cast<const uint8_t*>(header.data()), header.size());
+        m_file->copyRange(data, target + header.size(), end - data);
+        central.offset_of_local_header = static_cast<uint32_t>(target);
+        entry->relocate(static_cast<size_t>(target + header.size()));
+        m_end_of_central_directory_record.offset = directory;
+      }
+
+      bool removeEntry(const std::string& name)
+      {
+        const auto index = indexOf(name);
+        if (index == m_entries.size())
+        {
+          return false;
+        }
+        const auto& entry = m_entries[index];
+        if (index >= m_loaded_entries && !entry->isStaged())
+        {
+          m_memory_used -= entry->cachedData().size();
+        }
+        if (index < m_loaded_entries)
+        {
+          --m_loaded_entries;
+        }
+        m_index.erase(name);
+        m_entries.erase(m_entries.begin() + static_cast<std::ptrdiff_t>(index));
+        m_central_directory_file_headers.erase(m_central_directory_file_headers.begin() +
+                                               static_cast<std::ptrdiff_t>(index));
+        m_end_of_central_directory_record.total_entries--;
+        m_end_of_central_directory_record.disk_entries--;
+        persistDirectory();
+        return true;
+      }
+
+      /**
+       * Rewrites the central directory of a writable archive in place when all of its entries
+       * are stored in the file. Otherwise the change is kept until the archive is written.
+       */
+      void persistDirectory()
+      {
+        if (m_file && m_entries.size() == m_loaded_entries)
+        {
+          writeDirectory(m_end_of_central_directory_record.offset);
+        }
+      }
+
+      /**
+       * Writes the central directory at offset and truncates the file after it.
+       */
+      void writeDirectory(uint64_t offset)
+      {
+        std::vector<uint64_t> offsets;
+        offsets.reserve(m_central_directory_file_headers.size());
+        for (const auto& h : m_central_directory_file_headers)
+        {
+          offsets.push_back(h.offset_of_local_header);
+        }
+        std::ostringstream stream;
+        detail::OutputBuffer out(stream);
+        const auto record = writeCentralDirectory(out, offsets, offset, false);
+        out.flush();
+        const auto bytes = stream.str();
+        m_file->writeAt(offset, reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+        m_file->resize(offset + bytes.size());
+        m_end_of_central_directory_record = record;
+        m_digital_signature = {};
+      }
+
+      /**
+       * Returns the end of the local record of the loaded entry at index, including its data
+       * descriptor.
+       */
+      auto recordEnd(size_t index) const -> uint64_t
+      {
+        const auto& central = m_central_directory_file_headers[index];
+        auto end = static_cast<uint64_t>(m_entries[index]->dataOffset()) + central.compressed_size;
+        if (central.flags & 0x08)
+        {
+          uint32_t signature = 0;
+          m_source.read_at(end, reinterpret_cast<uint8_t*>(&signature), sizeof(signature));
+          const bool has_signature = boost::endian::little_to_native(signature) == data_descriptor_signature;
+          end += has_signature ? data_descriptor_size + sizeof(signature) : data_descriptor_size;
+        }
+        return end;
+      }
+
+      void compact()
+      {
+        if (!m_file)
+        {
+          throw std::runtime_error("Archive is not opened for writing");
+        }
+        if (m_entries.size() != m_loaded_entries)
+        {
+          throw std::runtime_error("Archive has entries which are not written yet");
+        }
+        std::vector<size_t> order(m_entries.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+          return m_central_directory_file_headers[a].offset_of_local_header <
+                 m_central_directory_file_headers[b].offset_of_local_header;
+        });
+        // Data in front of the first record which is not a local header, like the stub of a
+        // self extracting archive, is kept.
+        uint32_t signature = 0;
+        m_source.read_at(0, reinterpret_cast<uint8_t*>(&signature), sizeof(signature));
+        uint64_t cursor = 0;
+        if (!order.empty() && boost::endian::little_to_native(signature) != local_file_header_signature)
+        {
+          cursor = m_central_directory_file_headers[order.front()].offset_of_local_header;
+        }
+        // Every record is checked before the first one moves, so a broken layout leaves the file
+        // as it is.
+        std::vector<uint64_t> ends(m_entries.size());
+        uint64_t previous = cursor;
+        for (const auto index : order)
+        {
+          const auto& central = m_central_directory_file_headers[index];
+          ends[index] = recordEnd(index);
+          if (central.offset_of_local_header < previous || ends[index] > m_end_of_central_directory_record.offset)
+          {
+            throw std::runtime_error("Local record of " + central.file_name + " overlaps another one");
+          }
+          previous = ends[index];
+        }
+        // Records only ever move down, so each one is read before anything is written over it.
+        try
+        {
+          for (const auto index : order)
+          {
+            auto& central = m_central_directory_file_headers[index];
+            const uint64_t start = central.offset_of_local_header;
+            if (start != cursor)
+            {
+              m_file->copyRange(start, cursor, ends[index] - start);
+              const auto& entry = m_entries[index];
+              entry->relocate(static_cast<size_t>(entry->dataOffset() - (start - cursor)));
+              central.offset_of_local_header = static_cast<uint32_t>(cursor);
+            }
+            cursor += ends[index] - start;
+          }
+        }
+        catch (...)
+        {
+          // The records which were not moved yet are still in place and the directory behind
+          // them is untouched, so it is rewritten with the new offsets of the moved ones.
+          try
+          {
+            writeDirectory(m_end_of_central_directory_record.offset);
+          }
+          catch (...)
+          {
+          }
+          throw;
+        }
+        writeDirectory(cursor);
+      }
+
+      auto addFile(const std::string& entryName, const boost::filesystem::path& file)
       {
+        boost::filesystem::path path = makeCheckedPath(entryName);
+        if (!boost::filesystem::exists(file))
+        {
+          return false;
+        }
+
+        const auto content = readFile(file);
+        return addData(entryName, content.data(), content.size());
+      }
+
+      auto buildEntries(const boost::filesystem::path& path) -> boost::filesystem::path
+      {
+        return forEachParent(path, [this](const boost::filesystem::path& parent) {
+          if (!hasEntry(parent.string()))
+          {
+            newEntry(parent.string(), nullptr, 0);
+          }
+        });
+      }
+
+      /**
+       * The name buildEntries returns, without creating the parents.
+       */
+      static auto entryPath(const std::string& entryName) -> std::string
+      {
+        return forEachParent(makeCheckedPath(entryName), [](const boost::filesystem::path&) {}).string();
+      }
+
+      bool addData(const std::string& entryName, const void* data, uint64_t length)
+      {
+        if (m_concurrent_adds)
+        {
+          queueEntry(makeEntry(entryPath(entryName), data, length));
+          return true;
+        }
+        boost::filesystem::path path = makeCheckedPath(entryName);
+        boost::filesystem::path fullpath = buildEntries(path);
+        newEntry(fullpath.string(), data, length);
+        return true;
+      }
+
+      bool addData(const std::string& entryName, std::vector<uint8_t>&& data, CompressionMethod method)
+      {
+        if (m_concurrent_adds)
+        {
+          queueEntry(makeEntry(entryPath(entryName), std::move(data), method));
+          return true;
+        }
+        boost::filesystem::path fullpath = buildEntries(makeCheckedPath(entryName));
+        publishEntry(makeEntry(fullpath.string(), std::move(data), method));
+        return true;
+      }
+
+      bool addPrecompressed(const std::string& entryName,
+                            const uint8_t* payload,
+                            uint64_t compressed_size,
+                            uint32_t crc32,
+                            uint64_t uncompressed_size,
+                            CompressionMethod method)
+      {
+        checkPrecompressed(payload, compressed_size, uncompressed_size, method);
+        const auto h = makePrecompressedHeader(addedName(entryName), method, crc32, compressed_size, uncompressed_size);
+        submitEntry(prepareEntry(std::shared_ptr<ZipEntry>(new ZipEntry(h, payload))));
+        return true;
+      }
+
+      bool addPrecompressed(const std::string& entryName,
+                            std::vector<uint8_t>&& payload,
+                            uint32_t crc32,
+                            uint64_t uncompressed_size,
+                            CompressionMethod method)
+      {
+        checkPrecompressed(payload.data(), payload.size(), uncompressed_size, method);
+        const auto h = makePrecompressedHeader(addedName(entryName), method, crc32, payload.size(), uncompressed_size);
+        submitEntry(prepareEntry(std::shared_ptr<ZipEntry>(new ZipEntry(h, std::move(payload)))));
+        return true;
+      }
+
+      /**
+       * The name of an added entry. Its parents are created unless adds are concurrent, then
+       * publishPendingEntries creates them.
+       */
+      auto addedName(const std::string& entryName) -> std::string
+      {
+        return m_concurrent_adds ? entryPath(entryName) : buildEntries(makeCheckedPath(entryName)).string();
+      }
+
+      void submitEntry(ZipEntryPtr entry)
+      {
+        if (m_concurrent_adds)
+        {
+          queueEntry(std::move(entry));
+        }
+        else
+        {
+          publishEntry(std::move(entry));
+        }
+      }
+
+      bool addEntry(const std::string& entryName)
+      {
+        if (m_concurrent_adds)
+        {
+          queueEntry(makeEntry(entryPath(entryName), nullptr, 0));
+          return true;
+        }
         boost::filesystem::path path = makeCheckedPath(entryName);
         boost::filesystem::path fullpath = buildEntries(path);
         newEntry(fullpath.string(), nullptr, 0);
@@ -446,97 +1180,728 @@ namespace cppzip
 
       void newEntry(const std::string& name, const void* data, std::uint64_t length)
       {
-        const auto crc32 = detail::getCrc32(reinterpret_cast<const uint8_t*>(data), length);
-        const auto val = timestamp_now();
-        LocalFileHeader h{local_file_header_signature,
-                          VERSION,
-                          makeFlags(),
-                          makeCompressionMode(data),
-                          val,
-                          crc32,
-                          0,
-                          static_cast<uint32_t>(length),
-                          static_cast<uint16_t>(name.size()),
-                          0,
-                          name,
-                          {},
-                          {}};
-        m_entries.push_back(std::shared_ptr<ZipEntry>(new ZipEntry(h, data, length)));
+        publishEntry(makeEntry(name, data, length));
+      }
+
+      /**
+       * Stages an entry made on a producer thread and queues it for publishPendingEntries.
+       */
+      void queueEntry(ZipEntryPtr entry)
+      {
+        stage(*entry);
+        m_pending.push(std::move(entry));
+      }
+
+      void publishPendingEntries()
+      {
+        for (auto& entry : m_pending.take())
+        {
+          buildEntries(makeCheckedPath(entry->getEntryName()));
+          insertEntry(std::move(entry));
+        }
+      }
 
+      void setConcurrentAdds(bool enabled)
+      {
+        if (!enabled)
+        {
+          publishPendingEntries();
+        }
+        m_concurrent_adds = enabled;
+      }
+
+      /**
+       * Creates and compresses an entry without touching the entries of the archive, so it may
+       * run on any thread.
+       */
+      auto makeEntry(const std::string& name, const void* data, std::uint64_t length) -> ZipEntryPtr
+      {
+        if (m_cache && data && length >= m_cache_options.min_size)
+        {
+          return makeCachedEntry(name, static_cast<const uint8_t*>(data), length);
+        }
+        const auto h = makeHeader(name, makeCompressionMode(data), length);
+        if (auto file = data && length ? stagingFor(length) : nullptr)
+        {
+          return prepareEntry(std::shared_ptr<ZipEntry>(new ZipEntry(h, data, length, m_compression, std::move(file))));
+        }
+        return prepareEntry(std::shared_ptr<ZipEntry>(new ZipEntry(h, data, length, m_compression)));
+      }
+
+      auto makeEntry(const std::string& name, std::vector<uint8_t>&& data, CompressionMethod method) -> ZipEntryPtr
+      {
+        if (method != CompressionMethod::no && method != CompressionMethod::defalted)
+        {
+          throw std::runtime_error("Compression method not supported");
+        }
+        if (m_cache && method == CompressionMethod::defalted && data.size() >= m_cache_options.min_size)
+        {
+          auto entry = makeCachedEntry(name, data.data(), data.size());
+          std::vector<uint8_t>{}.swap(data);
+          return entry;
+        }
+        const auto h = makeHeader(name, static_cast<uint16_t>(method), data.size());
+        auto file = method == CompressionMethod::defalted && !data.empty() ? stagingFor(data.size()) : nullptr;
+        if (file)
+        {
+          auto entry = std::shared_ptr<ZipEntry>(new ZipEntry(h, data.data(), data.size(), m_compression, file));
+          std::vector<uint8_t>{}.swap(data);
+          return prepareEntry(std::move(entry));
+        }
+        return prepareEntry(std::shared_ptr<ZipEntry>(new ZipEntry(h, std::move(data), m_compression)));
+      }
+
+      /**
+       * Deflates through the compression cache and makes an entry of the result like
+       * addPrecompressed does.
+       */
+      auto makeCachedEntry(const std::string& name, const uint8_t* data, std::uint64_t length) const -> ZipEntryPtr
+      {
+        const auto& options = m_compression;
+        auto result = m_cache->deflate(data, static_cast<size_t>(length), options.level, [&] {
+          return detail::deflatePayload(data, static_cast<size_t>(length), options.level, options.block_size,
+                                        options.threads);
+        });
+        const auto h =
+            makePrecompressedHeader(name, CompressionMethod::defalted, result.crc32, result.data.size(), length);
+        return prepareEntry(std::shared_ptr<ZipEntry>(new ZipEntry(h, std::move(result.data))));
+      }
+
+      /**
+       * Encrypts the payload if the archive is encrypted and connects the entry to the executor.
+       */
+      auto prepareEntry(ZipEntryPtr entry) const -> ZipEntryPtr
+      {
+        entry->encrypt(m_encryption);
+        entry->setAsyncContext(m_async);
+        return entry;
+      }
+
+      static auto makePrecompressedHeader(const std::string& name,
+                                          CompressionMethod method,
+                                          uint32_t crc32,
+                                          std::uint64_t compressed_size,
+                                          std::uint64_t uncompressed_size) -> LocalFileHeader
+      {
+        auto h = makeHeader(name, static_cast<uint16_t>(method), uncompressed_size);
+        h.crc32 = crc32;
+        h.compressed_size = detail::checkedSize(compressed_size);
+        return h;
+      }
+
+      static auto makeHeader(const std::string& name, uint16_t method, std::uint64_t length) -> LocalFileHeader
+      {
+        return LocalFileHeader{local_file_header_signature,
+                               VERSION,
+                               makeFlags(),
+                               method,
+                               timestamp_now(),
+                               0,
+                               0,
+                               detail::checkedSize(length),
+                               static_cast<uint16_t>(name.size()),
+                               0,
+                               name,
+                               {},
+                               {}};
+      }
+
+      void publishEntry(ZipEntryPtr entry)
+      {
+        stage(*entry);
+        insertEntry(std::move(entry));
+      }
+
+      /**
+       * Appends an entry whose payload is already staged to the directory and the index.
+       */
+      void insertEntry(ZipEntryPtr entry)
+      {
+        const auto& h = entry->localHeader();
         CentralDirectoryFileHeader cf{central_directory_file_header_signature,
                                       VERSION,
-                                      VERSION_NEEDED_TO_EXTRACT,
-                                      makeFlags(),
-                                      makeCompressionMode(data),
-                                      val,
-                                      crc32,
-                                      static_cast<uint32_t>(m_entries.back()->compressedSize()),
-                                      static_cast<uint32_t>(length),
-                                      static_cast<uint16_t>(name.size()),
-                                      0,
+                                      std::max(h.version, VERSION_NEEDED_TO_EXTRACT),
+                                      h.flags,
+                                      h.compression_method,
+                                      h.file_modification,
+                                      h.crc32,
+                                      h.compressed_size,
+                                      h.uncompressed_size,
+                                      h.file_name_length,
+                                      h.extra_field_length,
                                       0,
                                       0,
                                       internalAttr(),
                                       externalAttr(),
                                       0,
-                                      name,
-                                      {},
+                                      h.file_name,
+                                      h.extra_field,
                                       {}};
 
         m_central_directory_file_headers.push_back(cf);
         m_end_of_central_directory_record.total_entries++;
         m_end_of_central_directory_record.disk_entries++;
+        m_index.insert(h.file_name, entry);
+        m_entries.push_back(std::move(entry));
+      }
+
+      /**
+       * Keeps the payload in memory while the budget allows it, otherwise moves it to the
+       * staging file.
+       */
+      void stage(ZipEntry& entry)
+      {
+        if (entry.isStaged())
+        {
+          return;
+        }
+        const auto size = entry.cachedData().size();
+        std::shared_ptr<detail::StagingFile> file;
+        {
+          // Concurrent producers share the budget, the payload is written without the lock.
+          std::lock_guard<std::mutex> lock(m_staging_mutex);
+          if (size < m_staging_options.min_staged_size || m_memory_used + size <= m_staging_options.memory_budget)
+          {
+            m_memory_used += size;
+            return;
+          }
+          file = stagingFile();
+        }
+        entry.stage(file);
+      }
+
+      /**
+       * The staging file if a payload compressed from length bytes might not fit into the
+       * budget, then it is compressed straight into the file. Encrypted payloads are built in
+       * memory and staged afterwards.
+       */
+      auto stagingFor(uint64_t length) -> std::shared_ptr<detail::StagingFile>
+      {
+        std::lock_guard<std::mutex> lock(m_staging_mutex);
+        if (!m_encryption.password.empty() || length < m_staging_options.min_staged_size ||
+            m_memory_used + length <= m_staging_options.memory_budget)
+        {
+          return nullptr;
+        }
+        return stagingFile();
+      }
+
+      /**
+       * Creates the staging file on first use. Called with m_staging_mutex held.
+       */
+      auto stagingFile() -> std::shared_ptr<detail::StagingFile>
+      {
+        if (!m_staging)
+        {
+          m_staging = std::make_shared<detail::StagingFile>(m_staging_options.directory.empty()
+                                                                ? boost::filesystem::temp_directory_path()
+                                                                : m_staging_options.directory);
+        }
+        return m_staging;
+      }
+
+      auto getSnapshot() const -> EntrySnapshot
+      {
+        EntrySnapshot snapshot;
+        const auto count = m_central_directory_file_headers.size();
+        snapshot.names.reserve(count);
+        snapshot.methods.reserve(count);
+        snapshot.crc32s.reserve(count);
+        snapshot.compressed_sizes.reserve(count);
+        snapshot.uncompressed_sizes.reserve(count);
+        snapshot.offsets.reserve(count);
+        snapshot.timestamps.reserve(count);
+        for (const auto& h : m_central_directory_file_headers)
+        {
+          snapshot.names.push_back(h.file_name);
+          snapshot.methods.push_back(static_cast<CompressionMethod>(h.compression));
+          snapshot.crc32s.push_back(h.crc32);
+          snapshot.compressed_sizes.push_back(h.compressed_size);
+          snapshot.uncompressed_sizes.push_back(h.uncompressed_size);
+          snapshot.offsets.push_back(h.offset_of_local_header);
+          snapshot.timestamps.push_back(dosTimeToTimestamp(h.file_modification));
+        }
+        return snapshot;
+      }
+
+      auto addDirectory(const boost::filesystem::path& root,
+                        const std::string& prefix,
+                        const PathFilter_fn& filter,
+                        const AddDirectoryOptions& options) -> size_t
+      {
+        std::vector<boost::filesystem::path> paths;
+        for (boost::filesystem::recursive_directory_iterator iter{root}, end; iter != end; ++iter)
+        {
+          if (filter && !filter(iter->path()))
+          {
+            if (boost::filesystem::is_directory(iter->status()))
+            {
+              iter.no_push();
+            }
+            continue;
+          }
+          if (boost::filesystem::is_directory(iter->status()) || boost::filesystem::is_regular_file(iter->status()))
+          {
+            paths.push_back(iter->path());
+          }
+        }
+        // Sorting makes the order of the entries independent of the file system.
+        std::sort(paths.begin(), paths.end());
+
+        const auto base = prefix.empty() ? boost::filesystem::path{} : makeCheckedPath(prefix);
+        auto entryName = [&](const boost::filesystem::path& p) {
+          return (base / p.lexically_relative(root)).generic_string();
+        };
+
+        struct Pending
+        {
+          std::future<ZipEntryPtr> entry;
+          uint64_t size;
+        };
+        std::deque<Pending> pending;
+        uint64_t in_flight = 0;
+        const size_t before = m_entries.size();
+        auto publishFront = [&] {
+          auto& front = pending.front();
+          auto entry = front.entry.get();
+          in_flight -= front.size;
+          pending.pop_front();
+          const auto name = entry->getEntryName();
+          if (entry->isDirectory())
+          {
+            if (hasEntry(name))
+            {
+              return;
+            }
+            // Only the parents, forEachParent counts the directory itself as one.
+            buildEntries(makeCheckedPath(name.substr(0, name.size() - 1)));
+          }
+          else
+          {
+            buildEntries(makeCheckedPath(name));
+          }
+          publishEntry(std::move(entry));
+        };
+
+        detail::ThreadPool pool(options.threads);
+        for (const auto& p : paths)
+        {
+          if (boost::filesystem::is_directory(p))
+          {
+            // Queued as a ready entry, so it stays in order with the files around it.
+            std::promise<ZipEntryPtr> directory;
+            directory.set_value(makeEntry(entryName(p) + "/", nullptr, 0));
+            pending.push_back({directory.get_future(), 0});
+            continue;
+          }
+          const uint64_t size = boost::filesystem::file_size(p);
+          // Bound the bytes read and compressed but not yet appended.
+          while (!pending.empty() && in_flight + size > options.max_in_flight_bytes)
+          {
+            publishFront();
+          }
+          in_flight += size;
+          readAhead(p);
+          pending.push_back({pool.submit([this, p, name = entryName(p)] {
+                               const auto content = readFile(p);
+                               return makeEntry(name, content.data(), content.size());
+                             }),
+                             size});
+        }
+        while (!pending.empty())
+        {
+          publishFront();
+        }
+        return m_entries.size() - before;
       }
 
       void writeArchive(std::ostream& ofOutput)
       {
-        size_t written = 0;
-        std::vector<size_t> offsets(1);
+        publishPendingEntries();
+        detail::OutputBuffer out(ofOutput);
+        writeArchive(out);
+      }
+
+      void writeArchive(std::vector<uint8_t>& output)
+      {
+        const auto size = computeArchiveSize();
+        checkLimits();
+        output.resize(static_cast<size_t>(size));
+        writeArchive(output.data(), output.size());
+      }
+
+      auto writeArchive(uint8_t* data, size_t size) -> size_t
+      {
+        publishPendingEntries();
+        detail::OutputBuffer out(data, size);
+        writeArchive(out);
+        return out.written();
+      }
+
+      auto computeArchiveSize() -> uint64_t
+      {
+        publishPendingEntries();
+        uint64_t size = end_of_central_directory_size + m_end_of_central_directory_record.zip_comment.size();
         for (const auto& e : m_entries)
         {
-          written += e->writeEntry(ofOutput);
-          offsets.push_back(written);
+          size += e->recordSize();
+        }
+        return size + centralDirectorySize();
+      }
+
+      auto centralDirectorySize() const -> uint64_t
+      {
+        uint64_t size = 0;
+        for (const auto& h : m_central_directory_file_headers)
+        {
+          size += central_directory_file_header_size + h.file_name.size() + h.extra_field.size() +
+                  h.file_comment.size();
         }
+        return size;
+      }
+
+      /**
+       * Throws if the archive would need zip64, before anything is written.
+       */
+      void checkLimits() const
+      {
+        checkEntryCount();
+        uint64_t end = 0;
+        for (const auto& e : m_entries)
+        {
+          checkedOffset(end);
+          end += e->recordSize();
+        }
+        checkedOffset(end);
+        checkedOffset(centralDirectorySize());
+      }
+
+      void checkEntryCount() const
+      {
+        if (m_central_directory_file_headers.size() >= std::numeric_limits<uint16_t>::max())
+        {
+          throw std::runtime_error("Archive has too many entries");
+        }
+      }
+
+      void writeArchive(detail::OutputBuffer& out)
+      {
+        checkLimits();
+        std::vector<uint64_t> offsets;
+        offsets.reserve(m_entries.size());
+        for (const auto& e : m_entries)
+        {
+          offsets.push_back(out.written());
+          e->writeEntry(out);
+        }
+        writeCentralDirectory(out, offsets, 0, true);
+        out.flush();
+      }
+
+      /**
+       * Writes the central directory with the given local header offsets, followed by the end
+       * of central directory record which is returned. base is the offset of out in the file.
+       * rewritten is set if the local records were written by writeEntry, which drops data
+       * descriptors.
+       */
+      auto writeCentralDirectory(detail::OutputBuffer& out,
+                                 const std::vector<uint64_t>& offsets,
+                                 uint64_t base,
+                                 bool rewritten) const -> EndOfCentralDirectoryRecord
+      {
+        checkEntryCount();
         auto iter = offsets.begin();
-        const auto cdoffset = written;
-        written = 0;
-        for (auto& h : m_central_directory_file_headers)
+        const auto cdoffset = out.written();
+        for (auto h : m_central_directory_file_headers)
         {
-          h.offset_of_local_header = *iter++;
-          written = boost::fusion::accumulate(h, written, detail::WriteToStream(ofOutput));
+          h.offset_of_local_header = checkedOffset(*iter++);
+          if (rewritten)
+          {
+            h.flags &= ~uint16_t(0x08);
+          }
+          boost::fusion::accumulate(h, size_t(0), detail::WriteToBuffer(out));
           if (h.file_name_length)
           {
-            ofOutput.write(h.file_name.data(), h.file_name.size());
-            written += h.file_name.size();
+            out.write(h.file_name.data(), h.file_name.size());
           }
           if (h.extra_field_length)
           {
-            ofOutput.write(reinterpret_cast<const char*>(h.extra_field.data()), h.extra_field.size());
-            written += h.extra_field.size();
+            out.write(h.extra_field.data(), h.extra_field.size());
           }
           if (h.file_comment_lenght)
           {
-            ofOutput.write(h.file_comment.data(), h.file_comment.size());
-            written += h.file_comment.size();
+            out.write(h.file_comment.data(), h.file_comment.size());
+          }
+        }
+        auto record = m_end_of_central_directory_record;
+        record.offset = checkedOffset(base + cdoffset);
+        record.central_directory_size = checkedOffset(out.written() - cdoffset);
+        boost::fusion::accumulate(record, size_t(0), detail::WriteToBuffer(out));
+        if (!record.zip_comment.empty())
+        {
+          out.write(record.zip_comment.data(), record.zip_comment.size());
+        }
+        return record;
+      }
+
+      /**
+       * Checks that the local records of the loaded entries lie within the data area and do
+       * not overlap each other.
+       */
+      void checkLayout(std::vector<EntryReport>& reports) const
+      {
+        std::vector<std::pair<uint64_t, size_t>> starts;
+        std::vector<uint64_t> ends(m_loaded_entries);
+        for (size_t i = 0; i < m_loaded_entries; ++i)
+        {
+          // The sizes of the local header are zero if the entry has a data descriptor.
+          ends[i] = recordEnd(i);
+          if (ends[i] > m_end_of_central_directory_record.offset)
+          {
+            reports[i].problems.push_back("Local record ends beyond the central directory");
+          }
+          starts.emplace_back(m_central_directory_file_headers[i].offset_of_local_header, i);
+        }
+        std::sort(starts.begin(), starts.end());
+        // A record may reach over several following ones, so each start is compared with the
+        // furthest end seen so far rather than with the end of its neighbour.
+        for (size_t i = 1, furthest = starts.empty() ? 0 : starts.front().second; i < starts.size(); ++i)
+        {
+          const auto current = starts[i].second;
+          if (ends[furthest] > starts[i].first)
+          {
+            reports[furthest].problems.push_back("Local record overlaps " + m_entries[current]->getEntryName());
+            reports[current].problems.push_back("Local record overlaps " + m_entries[furthest]->getEntryName());
+          }
+          if (ends[current] > ends[furthest])
+          {
+            furthest = current;
+          }
+        }
+      }
+
+      void checkEntry(size_t index, EntryReport& report) const
+      {
+        const auto& entry = m_entries[index];
+        const auto& central = m_central_directory_file_headers[index];
+        const auto& local = entry->localHeader();
+        // With a data descriptor the local header may carry zeros instead of the real values.
+        const bool descriptor = (local.flags & 0x08) != 0;
+        if (central.file_name != local.file_name)
+        {
+          report.problems.push_back("Local and central file name differ");
+        }
+        if (central.compression != local.compression_method)
+        {
+          report.problems.push_back("Local and central compression method differ");
+        }
+        if (!descriptor && (central.crc32 != local.crc32 || central.compressed_size != local.compressed_size ||
+                            central.uncompressed_size != local.uncompressed_size))
+        {
+          report.problems.push_back("Local and central CRC or sizes differ");
+        }
+
+        if (entry->isEncrypted())
+        {
+          // Decrypting authenticates the payload, the CRC of AE-2 entries is zero.
+          try
+          {
+            entry->loadContent();
+          }
+          catch (const std::exception& e)
+          {
+            report.problems.push_back(e.what());
           }
+          return;
         }
-        m_end_of_central_directory_record.offset = cdoffset;
-        m_end_of_central_directory_record.central_directory_size = written;
-        written =
-            boost::fusion::accumulate(m_end_of_central_directory_record, written, detail::WriteToStream(ofOutput));
-        if (!m_end_of_central_directory_record.zip_comment.empty())
+
+        detail::ReadAt_fn read;
+        if (index < m_loaded_entries)
+        {
+          const uint64_t base = entry->dataOffset();
+          read = [this, base](uint64_t o, uint8_t* b, size_t l) { return m_source.read_at(base + o, b, l); };
+        }
+        else
         {
-          ofOutput.write(m_end_of_central_directory_record.zip_comment.c_str(),
-                         m_end_of_central_directory_record.zip_comment.size());
+          read = entry->payloadReader();
+        }
+        try
+        {
+          const auto result = checkPayload(read, central.compressed_size, entry->getCompressionMethod());
+          if (result.crc32 != central.crc32)
+          {
+            report.problems.push_back("CRC mismatch");
+          }
+          if (result.size != central.uncompressed_size)
+          {
+            report.problems.push_back("Uncompressed size mismatch");
+          }
+        }
+        catch (const std::exception& e)
+        {
+          report.problems.push_back(e.what());
         }
       }
 
+      auto verify(unsigned threads) const -> std::vector<EntryReport>
+      {
+        std::vector<EntryReport> reports(m_entries.size());
+        for (size_t i = 0; i < m_entries.size(); ++i)
+        {
+          reports[i].name = m_entries[i]->getEntryName();
+        }
+        checkLayout(reports);
+        {
+          detail::ThreadPool pool(threads);
+          for (size_t i = 0; i < m_entries.size(); ++i)
+          {
+            pool.post([this, i, &reports] { checkEntry(i, reports[i]); });
+          }
+        }
+        return reports;
+      }
+
+      void readAll(const EntryContent_fn& fn, const BulkReadOptions& options) const
+      {
+        std::vector<ZipEntryPtr> files;
+        std::copy_if(m_entries.begin(), m_entries.end(), std::back_inserter(files),
+                     [](const ZipEntryPtr& e) { return e->isFile(); });
+        readFiles(files, fn, options);
+      }
+
+      void readEntries(const std::vector<std::string>& names,
+                       const EntryContent_fn& fn,
+                       const BulkReadOptions& options) const
+      {
+        std::vector<ZipEntryPtr> files;
+        files.reserve(names.size());
+        for (const auto& name : names)
+        {
+          const auto* entry = m_index.find(name);
+          if (!entry)
+          {
+            throw std::runtime_error("Entry not found: " + name);
+          }
+          files.push_back(*entry);
+        }
+        readFiles(files, fn, options);
+      }
+
+      /**
+       * Consecutive entries in offset order whose payloads are fetched with one read.
+       */
+      struct ReadSpan
+      {
+        size_t first;
+        size_t last;
+      };
+
+      void readFiles(const std::vector<ZipEntryPtr>& files,
+                     const EntryContent_fn& fn,
+                     const BulkReadOptions& options) const
+      {
+        // Added entries hold their payload in memory or in the staging file and need no batch I/O.
+        std::vector<ZipEntryPtr> stored;
+        std::vector<ZipEntryPtr> owned;
+        for (const auto& e : files)
+        {
+          (e->isInSource() ? stored : owned).push_back(e);
+        }
+        std::sort(stored.begin(), stored.end(),
+                  [](const ZipEntryPtr& a, const ZipEntryPtr& b) { return a->dataOffset() < b->dataOffset(); });
+
+        std::vector<ReadSpan> spans;
+        std::vector<detail::BatchItem> items;
+        for (size_t i = 0; i < stored.size(); ++i)
+        {
+          const uint64_t start = stored[i]->dataOffset();
+          const uint64_t end = start + stored[i]->compressedSize();
+          if (!spans.empty())
+          {
+            auto& item = items.back();
+            const auto span_end = item.offset + item.length;
+            if (start >= span_end && start - span_end <= options.coalesce_gap &&
+                end - item.offset <= options.max_coalesced_read)
+            {
+              item.length = static_cast<size_t>(end - item.offset);
+              spans.back().last = i;
+              continue;
+            }
+          }
+          spans.push_back({i, i});
+          items.push_back({start, static_cast<size_t>(end - start)});
+        }
+        items.resize(items.size() + owned.size(), detail::BatchItem{0, 0});
+
+        detail::readBatch(m_source, items, options, [&](size_t index, std::vector<uint8_t>& raw) {
+          if (index >= spans.size())
+          {
+            const auto& entry = owned[index - spans.size()];
+            fn(entry, entry->loadContent());
+            return;
+          }
+          const auto base = items[index].offset;
+          for (auto i = spans[index].first; i <= spans[index].last; ++i)
+          {
+            const auto& entry = stored[i];
+            if (const auto size = entry->compressedSize())
+            {
+              fn(entry, entry->decodeContent(raw.data() + (entry->dataOffset() - base), size));
+            }
+            else
+            {
+              fn(entry, {});
+            }
+          }
+        });
+      }
+
+      void extractAll(const boost::filesystem::path& directory, const BulkReadOptions& options) const
+      {
+        std::vector<ZipEntryPtr> files;
+        for (const auto& e : m_entries)
+        {
+          const auto target = makeExtractPath(directory, e->getEntryName());
+          boost::filesystem::create_directories(e->isDirectory() ? target : target.parent_path());
+          // Stored entries go through the batch as well, so their CRC is checked and they are
+          // read by the workers instead of one after another.
+          if (e->isFile())
+          {
+            files.push_back(e);
+          }
+        }
+        readFiles(
+            files,
+            [&directory](const ZipEntryPtr& entry, const std::vector<uint8_t>& content) {
+              detail::FileWriter out(makeExtractPath(directory, entry->getEntryName()));
+              out.preallocate(content.size());
+              out.write(content.data(), content.size());
+              out.close();
+            },
+            options);
+      }
+
       boost::filesystem::path m_path;
-      std::function<long long(std::streamsize, std::ios::seekdir, uint8_t*, size_t)> m_read;
+      detail::ArchiveSourcePtr m_storage;
+      detail::ReadSource m_source;
+      std::shared_ptr<FileAccess> m_file;
+      CompressionOptions m_compression;
+      EncryptionOptions m_encryption;
+      StagingOptions m_staging_options;
+      CompressionCacheOptions m_cache_options;
+      std::shared_ptr<detail::CompressionCache> m_cache;
+      std::shared_ptr<detail::StagingFile> m_staging;
+      std::mutex m_staging_mutex;
+      uint64_t m_memory_used = 0;
+      bool m_concurrent_adds = false;
+      PendingEntries m_pending;
+      size_t m_loaded_entries = 0;
+      std::shared_ptr<detail::AsyncContext> m_async = std::make_shared<detail::AsyncContext>();
       EndOfCentralDirectoryRecord m_end_of_central_directory_record;
       std::vector<CentralDirectoryFileHeader> m_central_directory_file_headers;
       DigitalSignature m_digital_signature;
       std::vector<std::shared_ptr<ZipEntry>> m_entries;
+      detail::PathIndex<ZipEntryPtr> m_index;
     };
 
     ZipArchive::ZipArchive() : impl{std::make_unique<ZipArchive::pimpl>()}
@@ -553,6 +1918,18 @@ namespace cppzip
     {
     }
 
+    ZipArchive::ZipArchive(const uint8_t* data, size_t size) : impl{std::make_unique<ZipArchive::pimpl>(data, size)}
+    {
+    }
+
+    ZipArchive::ZipArchive(std::shared_ptr<const RandomAccessSource> source, const SourceCacheOptions& options)
+      : impl{std::make_unique<ZipArchive::pimpl>(std::move(source), options)}
+    {
+    }
+
+    ZipArchive::ZipArchive(ZipArchive&&) noexcept = default;
+    ZipArchive& ZipArchive::operator=(ZipArchive&&) noexcept = default;
+
     ZipArchive::~ZipArchive() = default;
 
     auto ZipArchive::getPath() const -> boost::filesystem::path
@@ -565,6 +1942,11 @@ namespace cppzip
       return impl->isEncrypted();
     }
 
+    void ZipArchive::setPassword(const std::string& password)
+    {
+      impl->setPassword(password);
+    }
+
     void ZipArchive::setComment(const std::string& comment)
     {
       impl->setComment(comment);
@@ -595,11 +1977,36 @@ namespace cppzip
       return impl->getEntry(name);
     }
 
-    bool ZipArchive::renameEntry(const std::string& entry, const std::string& newName) const
+    auto ZipArchive::listDirectory(const std::string& directory) const -> std::vector<std::string>
+    {
+      return impl->listDirectory(directory);
+    }
+
+    auto ZipArchive::walkDirectory(const std::string& directory) const -> std::vector<ZipEntryPtr>
+    {
+      return impl->walkDirectory(directory);
+    }
+
+    auto ZipArchive::findEntries(const std::string& pattern) const -> std::vector<ZipEntryPtr>
+    {
+      return impl->findEntries(pattern);
+    }
+
+    bool ZipArchive::renameEntry(const std::string& entry, const std::string& newName)
     {
       return impl->renameEntry(entry, newName);
     }
 
+    bool ZipArchive::removeEntry(const std::string& name)
+    {
+      return impl->removeEntry(name);
+    }
+
+    void ZipArchive::compact()
+    {
+      impl->compact();
+    }
+
     auto ZipArchive::addFile(const std::string& entryName, const boost::filesystem::path& file) -> bool
     {
       return impl->addFile(entryName, file);
@@ -610,6 +2017,83 @@ namespace cppzip
       return impl->addData(entryName, data, length);
     }
 
+    auto ZipArchive::addData(const std::string& entryName, std::vector<uint8_t>&& data, CompressionMethod method)
+        -> bool
+    {
+      return impl->addData(entryName, std::move(data), method);
+    }
+
+    auto ZipArchive::addPrecompressed(const std::string& entryName,
+                                      const void* payload,
+                                      uint64_t compressedSize,
+                                      uint32_t crc32,
+                                      uint64_t uncompressedSize,
+                                      CompressionMethod method) -> bool
+    {
+      return impl->addPrecompressed(entryName, static_cast<const uint8_t*>(payload), compressedSize, crc32,
+                                    uncompressedSize, method);
+    }
+
+    auto ZipArchive::addPrecompressed(const std::string& entryName,
+                                      std::vector<uint8_t>&& payload,
+                                      uint32_t crc32,
+                                      uint64_t uncompressedSize,
+                                      CompressionMethod method) -> bool
+    {
+      return impl->addPrecompressed(entryName, std::move(payload), crc32, uncompressedSize, method);
+    }
+
+    auto ZipArchive::verify(unsigned threads) const -> std::vector<EntryReport>
+    {
+      return impl->verify(threads);
+    }
+
+    auto ZipArchive::getSnapshot() const -> EntrySnapshot
+    {
+      return impl->getSnapshot();
+    }
+
+    auto ZipArchive::addDirectory(const boost::filesystem::path& root,
+                                  const std::string& prefix,
+                                  const PathFilter_fn& filter,
+                                  const AddDirectoryOptions& options) -> size_t
+    {
+      return impl->addDirectory(root, prefix, filter, options);
+    }
+
+    void ZipArchive::setCompressionOptions(const CompressionOptions& options)
+    {
+      impl->m_compression = options;
+    }
+
+    void ZipArchive::setStagingOptions(const StagingOptions& options)
+    {
+      impl->m_staging_options = options;
+    }
+
+    void ZipArchive::setCompressionCache(const CompressionCacheOptions& options)
+    {
+      impl->m_cache = options.directory.empty()
+                          ? nullptr
+                          : std::make_shared<detail::CompressionCache>(options.directory, options.max_size);
+      impl->m_cache_options = options;
+    }
+
+    void ZipArchive::setEncryptionOptions(const EncryptionOptions& options)
+    {
+      impl->m_encryption = options;
+    }
+
+    void ZipArchive::setConcurrentAdds(bool enabled)
+    {
+      impl->setConcurrentAdds(enabled);
+    }
+
+    void ZipArchive::publishPendingEntries()
+    {
+      impl->publishPendingEntries();
+    }
+
     bool ZipArchive::addEntry(const std::string& entryName)
     {
       return impl->addEntry(entryName);
@@ -619,5 +2103,42 @@ namespace cppzip
     {
       return impl->writeArchive(ofOutput);
     }
+
+    void ZipArchive::writeArchive(std::vector<uint8_t>& output)
+    {
+      impl->writeArchive(output);
+    }
+
+    auto ZipArchive::writeArchive(uint8_t* data, size_t size) -> size_t
+    {
+      return impl->writeArchive(data, size);
+    }
+
+    auto ZipArchive::computeArchiveSize() -> uint64_t
+    {
+      return impl->computeArchiveSize();
+    }
+
+    void ZipArchive::setExecutor(Executor executor)
+    {
+      impl->m_async->setExecutor(std::move(executor));
+    }
+
+    void ZipArchive::readAll(const EntryContent_fn& fn, const BulkReadOptions& options) const
+    {
+      impl->readAll(fn, options);
+    }
+
+    void ZipArchive::readEntries(const std::vector<std::string>& names,
+                                 const EntryContent_fn& fn,
+                                 const BulkReadOptions& options) const
+    {
+      impl->readEntries(names, fn, options);
+    }
+
+    void ZipArchive::extractAll(const boost::filesystem::path& directory, const BulkReadOptions& options) const
+    {
+      impl->extractAll(directory, options);
+    }
   } // namespace v1
 } // namespace cppzip
@@ -5,43 +5,252 @@
 //		Distributed under rhe MIT License.
 //		(See accompanying file LICENSE)
 
+#include <aes_crypto.h>
+#include <archive_source.h>
+#include <async_context.h>
 #include <boost/fusion/include/accumulate.hpp>
 #include <boost/fusion/include/for_each.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/device/back_inserter.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include <boost/iostreams/filtering_streambuf.hpp>
 #include <boost/iostreams/stream.hpp>
+#include <codec_pool.h>
+#include <cppzip/v1/zip_archive.h>
 #include <cppzip/v1/zip_entry.h>
+#include <file_writer.h>
 #include <helper.h>
+#include <inflate_index.h>
 #include <local_file_header.h>
+#include <output_buffer.h>
+#include <parallel_deflate.h>
+#include <raw_inflater.h>
+#include <staging_file.h>
 #include <zip_functions.h>
 
 namespace cppzip
 {
   inline namespace v1
   {
+    namespace
+    {
+      constexpr uint64_t default_index_spacing = 1 << 20;
+      constexpr uint16_t aes_version_needed = 51;
+
+      /**
+       * The strong encryption ids of AES-128, AES-192 and AES-256 follow this one.
+       */
+      constexpr uint16_t aes_algorithm_id = 0x660D;
+    } // namespace
+
     struct ZipEntry::pimpl
     {
-      pimpl(const LocalFileHeader& lf, size_t o, FileRead_fn fn)
-        : m_local_file_header{lf}, m_offset{o}, m_read{std::move(fn)}, m_data{}
+      pimpl(const LocalFileHeader& lf, size_t o, std::shared_ptr<const detail::ArchiveSource> source)
+        : m_local_file_header{lf}, m_offset{o}, m_source{std::move(source)}, m_mapped{}, m_data{}
+      {
+        m_mapped = m_source->data() ? m_source->data() + m_offset : nullptr;
+        m_fd = m_source->nativeHandle();
+        if (isEncrypted() && m_local_file_header.compression_method == detail::aes_compression_method &&
+            !detail::findAesField(m_local_file_header.extra_field, m_aes))
+        {
+          m_aes = {};
+        }
+      }
+
+      pimpl(const LocalFileHeader& lf, const void* data, std::uint64_t length, const CompressionOptions& options)
+        : m_local_file_header{lf}, m_offset{}, m_source{}, m_mapped{}, m_data{}
+      {
+        compress(reinterpret_cast<const uint8_t*>(data), length, options);
+      }
+
+      /**
+       * Deflates straight into the staging file, the compressed payload is never held in memory.
+       */
+      pimpl(const LocalFileHeader& lf,
+            const void* data,
+            std::uint64_t length,
+            const CompressionOptions& options,
+            std::shared_ptr<detail::StagingFile> staging)
+        : m_local_file_header{lf}, m_offset{}, m_source{}, m_mapped{}, m_data{}
+      {
+        const auto bound = detail::deflatePayloadBound(length, options.block_size);
+        const auto offset = staging->reserve(bound);
+        uint64_t written = 0;
+        m_local_file_header.crc32 =
+            detail::deflatePayload(reinterpret_cast<const uint8_t*>(data), static_cast<size_t>(length), options.level,
+                                   options.block_size, options.threads, [&](const uint8_t* chunk, size_t n) {
+                                     if (written + n > bound)
+                                     {
+                                       throw std::runtime_error("Could not compress data");
+                                     }
+                                     staging->writeAt(offset + written, chunk, n);
+                                     written += n;
+                                   });
+        m_local_file_header.compressed_size = detail::checkedSize(written);
+        m_staging = std::move(staging);
+        m_staged_offset = offset;
+      }
+
+      pimpl(const LocalFileHeader& lf, std::vector<uint8_t>&& data, const CompressionOptions& options)
+        : m_local_file_header{lf}, m_offset{}, m_source{}, m_mapped{}, m_data{}
+      {
+        if (getCompressionMethod() == CompressionMethod::no)
+        {
+          // The buffer becomes the payload.
+          m_local_file_header.crc32 = detail::getCrc32(data.data(), data.size());
+          m_local_file_header.compressed_size = detail::checkedSize(data.size());
+          m_data = std::move(data);
+          return;
+        }
+        compress(data.data(), data.size(), options);
+        std::vector<uint8_t>{}.swap(data);
+      }
+
+      /**
+       * The payload was compressed elsewhere, lf carries its CRC and sizes.
+       */
+      pimpl(const LocalFileHeader& lf, const uint8_t* payload)
+        : m_local_file_header{lf}, m_offset{}, m_source{}, m_mapped{lf.compressed_size ? payload : nullptr}, m_data{}
       {
       }
 
-      pimpl(const LocalFileHeader& lf, const void* data, std::uint64_t length)
-        : m_local_file_header{lf}, m_offset{}, m_read{}, m_data{}
+      pimpl(const LocalFileHeader& lf, std::vector<uint8_t>&& payload)
+        : m_local_file_header{lf}, m_offset{}, m_source{}, m_mapped{}, m_data{std::move(payload)}
+      {
+      }
+
+      void compress(const uint8_t* bytes, std::uint64_t length, const CompressionOptions& options)
       {
         if (length)
         {
-          boost::iostreams::array_source arrs{reinterpret_cast<const char*>(data), length};
-          boost::iostreams::filtering_istreambuf iin;
-          boost::iostreams::zlib_params params{};
-          params.noheader = true;
-          iin.push(boost::iostreams::zlib_compressor{params});
-          iin.push(arrs);
-          m_data.assign(std::istreambuf_iterator<char>{&iin}, {});
-          m_local_file_header.compressed_size = static_cast<uint32_t>(m_data.size());
+          auto result = detail::deflatePayload(bytes, length, options.level, options.block_size, options.threads);
+          m_data = std::move(result.data);
+          m_local_file_header.crc32 = result.crc32;
+          m_local_file_header.compressed_size = detail::checkedSize(m_data.size());
+        }
+        else
+        {
+          // A 0-byte payload is not a valid deflate stream, store it instead.
+          m_local_file_header.compression_method = static_cast<uint16_t>(CompressionMethod::no);
+        }
+      }
+
+      /**
+       * Encrypts the payload with WinZip AES (AE-2). Empty files and directories stay as they are.
+       */
+      void encrypt(const EncryptionOptions& options)
+      {
+        if (options.password.empty() || !m_local_file_header.uncompressed_size)
+        {
+          return;
+        }
+        const detail::AesField field{2, static_cast<uint8_t>(options.strength), m_local_file_header.compression_method};
+        if (m_mapped)
+        {
+          // A borrowed payload is encrypted into a buffer of the entry.
+          m_data.assign(m_mapped, m_mapped + m_local_file_header.compressed_size);
+          m_mapped = nullptr;
+        }
+        m_data = detail::aesEncrypt(options.password, field.strength, m_data);
+        auto& h = m_local_file_header;
+        const auto record = detail::makeAesField(field);
+        h.extra_field.insert(h.extra_field.end(), record.begin(), record.end());
+        h.extra_field_length = static_cast<uint16_t>(h.extra_field.size());
+        h.version = std::max<uint16_t>(h.version, aes_version_needed);
+        h.flags |= 1;
+        h.compression_method = detail::aes_compression_method;
+        h.crc32 = 0;
+        h.compressed_size = detail::checkedSize(m_data.size());
+        m_aes = field;
+        setPassword(options.password);
+      }
+
+      void setPassword(const std::string& password)
+      {
+        std::lock_guard<std::mutex> lock(m_keys_mutex);
+        m_password = password;
+        m_keys.reset();
+      }
+
+      bool isEncrypted() const noexcept
+      {
+        return (m_local_file_header.flags & 1) != 0;
+      }
+
+      /**
+       * AE-2 entries carry no CRC, the authentication code protects them instead.
+       */
+      bool crcMatches(uint32_t crc) const noexcept
+      {
+        return (m_aes.strength && m_aes.version == 2) || crc == m_local_file_header.crc32;
+      }
+
+      /**
+       * Derives the keys of an AES entry from the salt and the password verifier in front of
+       * its payload. They are kept until the password changes.
+       */
+      auto aesKeys(const uint8_t* payload, size_t length) const -> std::shared_ptr<const detail::AesKeys>
+      {
+        if (!m_aes.strength)
+        {
+          throw std::runtime_error("Encryption method not supported");
+        }
+        if (length < detail::aesOverhead(m_aes.strength))
+        {
+          throw std::runtime_error("File is corrupt");
+        }
+        std::lock_guard<std::mutex> lock(m_keys_mutex);
+        if (!m_keys)
+        {
+          if (m_password.empty())
+          {
+            throw std::runtime_error("Entry is encrypted, a password is required");
+          }
+          auto keys = detail::deriveAesKeys(m_password, payload, m_aes.strength);
+          if (!std::equal(keys.verifier.begin(), keys.verifier.end(), payload + detail::aesSaltSize(m_aes.strength)))
+          {
+            throw std::runtime_error("Wrong password");
+          }
+          m_keys = std::make_shared<const detail::AesKeys>(std::move(keys));
+        }
+        return m_keys;
+      }
+
+      /**
+       * Reads the encrypted data of an AES entry and decrypts it on the fly.
+       */
+      auto aesReader() const -> std::shared_ptr<detail::AesReader>
+      {
+        if (!m_aes.strength)
+        {
+          throw std::runtime_error("Encryption method not supported");
+        }
+        const auto read = payloadReader();
+        const auto length = m_local_file_header.compressed_size;
+        std::vector<uint8_t> header(detail::aesSaltSize(m_aes.strength) + detail::aes_verifier_size);
+        if (read(0, header.data(), header.size()) != header.size())
+        {
+          throw std::runtime_error("Could not read payload");
+        }
+        const auto keys = aesKeys(header.data(), length);
+        return std::make_shared<detail::AesReader>(read, *keys, header.size(), contentSize());
+      }
+
+      /**
+       * Positional reads of the compressed content, decrypted if the entry is encrypted.
+       */
+      auto contentReader() const -> detail::ReadAt_fn
+      {
+        if (!isEncrypted())
+        {
+          return payloadReader();
         }
+        const auto reader = aesReader();
+        return [reader](uint64_t o, uint8_t* b, size_t l) { return reader->read(o, b, l); };
+      }
+
+      auto contentSize() const noexcept -> uint64_t
+      {
+        const uint64_t overhead = m_aes.strength ? detail::aesOverhead(m_aes.strength) : 0;
+        return m_local_file_header.compressed_size > overhead ? m_local_file_header.compressed_size - overhead : 0;
       }
 
       auto getEntryName() const -> std::string
@@ -58,12 +267,16 @@ namespace cppzip
 
       auto getCompressionMethod() const noexcept -> CompressionMethod
       {
-        return static_cast<CompressionMethod>(m_local_file_header.compression_method);
+        return static_cast<CompressionMethod>(m_aes.strength ? m_aes.method : m_local_file_header.compression_method);
       }
 
       auto getEncryptionMethod() const noexcept -> uint16_t
       {
-        return 0;
+        if (!isEncrypted())
+        {
+          return 0;
+        }
+        return m_aes.strength ? static_cast<uint16_t>(aes_algorithm_id + m_aes.strength) : 1;
       }
 
       auto getCompressedSize() const noexcept -> uint64_t
@@ -103,74 +316,492 @@ namespace cppzip
         return m_local_file_header.file_name;
       }
 
+      bool hasView() const noexcept
+      {
+        return (m_mapped || (!m_source && !m_staging && !m_data.empty())) &&
+               getCompressionMethod() == CompressionMethod::no && !isEncrypted();
+      }
+
+      auto getView(bool verify) const -> ContentView
+      {
+        if (!hasView())
+        {
+          throw std::runtime_error("Entry cannot be viewed in place");
+        }
+        const ContentView view{m_mapped ? m_mapped : m_data.data(), m_local_file_header.compressed_size};
+        if (verify && detail::getCrc32(view.data, view.size) != m_local_file_header.crc32)
+        {
+          throw std::runtime_error("File is corrupt");
+        }
+        return view;
+      }
+
       auto readContent(std::ostream& ofOutput) const -> int64_t
       {
-        if (m_data.empty() && m_local_file_header.uncompressed_size)
+        if (hasView())
+        {
+          const auto view = getView(true);
+          ofOutput.write(reinterpret_cast<const char*>(view.data), view.size);
+          return static_cast<int64_t>(view.size);
+        }
+        if (m_staging || m_local_file_header.uncompressed_size || !m_data.empty())
+        {
+          // The payload is not cached, readContentAsync may read the entry at the same time.
+          const auto data = loadContent();
+          ofOutput.write(reinterpret_cast<const char*>(data.data()), data.size());
+          return static_cast<int64_t>(data.size());
+        }
+        return -1;
+      }
+
+      /**
+       * Decodes the payload without caching it, so it may run on any thread.
+       */
+      auto loadContent() const -> std::vector<uint8_t>
+      {
+        if (m_mapped)
+        {
+          return decodeContent(m_mapped, m_local_file_header.compressed_size);
+        }
+        if (!m_data.empty())
+        {
+          return decodeContent(m_data.data(), m_data.size());
+        }
+        if (!m_local_file_header.uncompressed_size)
+        {
+          return {};
+        }
+        std::vector<uint8_t> raw(m_local_file_header.compressed_size);
+        const auto res = m_staging ? m_staging->readAt(m_staged_offset, raw.data(), raw.size())
+                                   : m_source->readAt(m_offset, raw.data(), raw.size());
+        if (res != raw.size())
+        {
+          throw std::runtime_error("Could not read payload");
+        }
+        return decodeContent(raw.data(), raw.size());
+      }
+
+      auto decodeContent(const uint8_t* compressed, size_t length) const -> std::vector<uint8_t>
+      {
+        if (isEncrypted())
+        {
+          const auto plain = detail::aesDecrypt(*aesKeys(compressed, length), compressed, length);
+          return decodePlain(plain.data(), plain.size());
+        }
+        return decodePlain(compressed, length);
+      }
+
+      auto decodePlain(const uint8_t* compressed, size_t length) const -> std::vector<uint8_t>
+      {
+        std::vector<uint8_t> data;
+        switch (getCompressionMethod())
+        {
+        case CompressionMethod::no:
+          data.assign(compressed, compressed + length);
+          break;
+        case CompressionMethod::defalted:
+          data = detail::inflateRaw(compressed, length, m_local_file_header.uncompressed_size);
+          break;
+        default:
+          throw std::runtime_error("Compression method not supported");
+        }
+        if (data.size() != m_local_file_header.uncompressed_size ||
+            !crcMatches(detail::getCrc32(data.data(), data.size())))
+        {
+          throw std::runtime_error("File is corrupt");
+        }
+        return data;
+      }
+
+      /**
+       * Positional reads relative to the start of the payload.
+       */
+      auto payloadReader() const -> detail::ReadAt_fn
+      {
+        if (m_mapped)
+        {
+          return [this](uint64_t o, uint8_t* b, size_t l) -> size_t {
+            if (o >= m_local_file_header.compressed_size)
+            {
+              return 0;
+            }
+            l = std::min<size_t>(l, m_local_file_header.compressed_size - o);
+            memcpy(b, m_mapped + o, l);
+            return l;
+          };
+        }
+        if (m_staging)
+        {
+          return [this](uint64_t o, uint8_t* b, size_t l) -> size_t {
+            if (o >= m_local_file_header.compressed_size)
+            {
+              return 0;
+            }
+            l = std::min<size_t>(l, m_local_file_header.compressed_size - o);
+            return m_staging->readAt(m_staged_offset + o, b, l);
+          };
+        }
+        if (!m_source)
+        {
+          return [this](uint64_t o, uint8_t* b, size_t l) -> size_t {
+            if (o >= m_data.size())
+            {
+              return 0;
+            }
+            l = std::min<size_t>(l, m_data.size() - o);
+            memcpy(b, m_data.data() + o, l);
+            return l;
+          };
+        }
+        return [this](uint64_t o, uint8_t* b, size_t l) -> size_t {
+          if (o >= m_local_file_header.compressed_size)
+          {
+            return 0;
+          }
+          l = std::min<size_t>(l, m_local_file_header.compressed_size - o);
+          return m_source->readAt(m_offset + o, b, l);
+        };
+      }
+
+      auto index(uint64_t spacing) const -> std::shared_ptr<const detail::InflateIndex>
+      {
+        std::lock_guard<std::mutex> lock(m_index_mutex);
+        if (!m_index)
         {
-          m_data.resize(m_local_file_header.compressed_size);
-          const auto res = m_read(m_offset, std::ios::beg, m_data.data(), m_data.size());
-          if (static_cast<size_t>(res) != m_data.size())
+          m_index = std::make_shared<detail::InflateIndex>(
+              detail::InflateIndex::build(contentReader(), contentSize(), spacing));
+        }
+        return m_index;
+      }
+
+      auto readRange(uint64_t offset, size_t length) const -> std::vector<uint8_t>
+      {
+        if (offset >= m_local_file_header.uncompressed_size)
+        {
+          return {};
+        }
+        length = static_cast<size_t>(std::min<uint64_t>(length, m_local_file_header.uncompressed_size - offset));
+        std::vector<uint8_t> result(length);
+        const auto read = contentReader();
+        size_t done = 0;
+        switch (getCompressionMethod())
+        {
+        case CompressionMethod::no:
+          while (done < length)
           {
-            throw std::runtime_error("Could not read payload");
+            const auto res = read(offset + done, result.data() + done, length - done);
+            if (!res)
+            {
+              break;
+            }
+            done += res;
           }
+          break;
+        case CompressionMethod::defalted:
+          done = index(default_index_spacing)->extract(read, offset, result.data(), length);
+          break;
+        default:
+          throw std::runtime_error("Compression method not supported");
         }
-        if (!m_data.empty())
+        result.resize(done);
+        return result;
+      }
+
+      void buildIndex(uint64_t spacing)
+      {
         {
-          boost::iostreams::array_source arrs{reinterpret_cast<const char*>(m_data.data()), m_data.size()};
-          boost::iostreams::filtering_istreambuf iin;
-          boost::iostreams::zlib_params params{};
-          params.noheader = true;
-          iin.push(boost::iostreams::zlib_decompressor{params});
-          iin.push(arrs);
+          std::lock_guard<std::mutex> lock(m_index_mutex);
+          m_index.reset();
+        }
+        index(spacing);
+      }
 
-          std::vector<uint8_t> data(std::istreambuf_iterator<char>{&iin}, {});
-          auto crc = detail::getCrc32(data.data(), data.size());
-          if (crc != m_local_file_header.crc32)
+      void saveIndex(std::ostream& out) const
+      {
+        index(default_index_spacing)
+            ->save(out, m_local_file_header.crc32, m_local_file_header.compressed_size);
+      }
+
+      bool loadIndex(std::istream& in)
+      {
+        auto loaded = std::make_shared<detail::InflateIndex>();
+        if (!loaded->load(in, m_local_file_header.crc32, m_local_file_header.compressed_size))
+        {
+          return false;
+        }
+        std::lock_guard<std::mutex> lock(m_index_mutex);
+        m_index = std::move(loaded);
+        return true;
+      }
+
+      auto extractTo(const boost::filesystem::path& path, bool verify) const -> uint64_t
+      {
+        if (isDirectory())
+        {
+          boost::filesystem::create_directories(path);
+          return 0;
+        }
+        try
+        {
+          detail::FileWriter out(path);
+          out.preallocate(m_local_file_header.uncompressed_size);
+          if (isEncrypted())
           {
-            throw std::runtime_error("File is corrupt");
+            extractEncrypted(out);
+            out.close();
+            return m_local_file_header.uncompressed_size;
           }
-          ofOutput.write(reinterpret_cast<const char*>(data.data()), data.size());
-          return static_cast<int>(data.size());
+          switch (getCompressionMethod())
+          {
+          case CompressionMethod::no:
+            if (m_mapped || !m_data.empty())
+            {
+              const auto* data = m_mapped ? m_mapped : m_data.data();
+              if (verify && detail::getCrc32(data, m_local_file_header.compressed_size) != m_local_file_header.crc32)
+              {
+                throw std::runtime_error("File is corrupt");
+              }
+              out.write(data, m_local_file_header.compressed_size);
+            }
+            else if (m_fd >= 0 && !verify)
+            {
+              out.copyFrom(m_fd, m_offset, m_local_file_header.compressed_size);
+            }
+            else
+            {
+              checkCrc(copyPayload(out, payloadReader(), m_local_file_header.compressed_size));
+            }
+            break;
+          case CompressionMethod::defalted:
+            checkCrc(inflatePayload(out, payloadReader(), m_local_file_header.compressed_size));
+            break;
+          default:
+            throw std::runtime_error("Compression method not supported");
+          }
+          out.close();
         }
-        return -1;
+        catch (...)
+        {
+          boost::system::error_code ec;
+          boost::filesystem::remove(path, ec);
+          throw;
+        }
+        return m_local_file_header.uncompressed_size;
+      }
+
+      /**
+       * Decrypts the payload while it is copied or inflated and checks the authentication code.
+       */
+      void extractEncrypted(detail::FileWriter& out) const
+      {
+        const auto reader = aesReader();
+        const detail::ReadAt_fn read = [reader](uint64_t o, uint8_t* b, size_t l) { return reader->read(o, b, l); };
+        uint32_t crc = 0;
+        switch (getCompressionMethod())
+        {
+        case CompressionMethod::no:
+          crc = copyPayload(out, read, contentSize());
+          break;
+        case CompressionMethod::defalted:
+          crc = inflatePayload(out, read, contentSize());
+          break;
+        default:
+          throw std::runtime_error("Compression method not supported");
+        }
+        uint8_t mac[detail::aes_mac_size];
+        const auto length = m_local_file_header.compressed_size;
+        if (payloadReader()(length - sizeof(mac), mac, sizeof(mac)) != sizeof(mac) || !reader->authentic(mac))
+        {
+          throw std::runtime_error("File is corrupt");
+        }
+        checkCrc(crc);
+      }
+
+      void checkCrc(uint32_t crc) const
+      {
+        if (!crcMatches(crc))
+        {
+          throw std::runtime_error("File is corrupt");
+        }
+      }
+
+      /**
+       * Writes a stored payload through an aligned buffer and returns its CRC.
+       */
+      auto copyPayload(detail::FileWriter& out, const detail::ReadAt_fn& read, uint64_t length) const -> uint32_t
+      {
+        detail::AlignedBuffer buffer(detail::file_write_chunk_size);
+        uint32_t crc = 0;
+        uint64_t done = 0;
+        while (done < length)
+        {
+          const auto n = read(done, buffer.data(), buffer.size());
+          if (!n)
+          {
+            throw std::runtime_error("Could not read payload");
+          }
+          crc = static_cast<uint32_t>(crc32(crc, buffer.data(), static_cast<uInt>(n)));
+          out.write(buffer.data(), n);
+          done += n;
+        }
+        return crc;
       }
 
-      size_t writeEntry(std::ostream& ofOutput)
+      /**
+       * Inflates a deflated payload into an aligned buffer which is written whenever it is full.
+       * Checks the size and returns the CRC.
+       */
+      auto inflatePayload(detail::FileWriter& out, const detail::ReadAt_fn& read, uint64_t length) const -> uint32_t
       {
-        auto written = boost::fusion::accumulate(m_local_file_header, size_t(0), detail::WriteToStream(ofOutput));
+        detail::RawInflater inflater(read, length, 0);
+        detail::AlignedBuffer buffer(detail::file_write_chunk_size);
+        uint32_t crc = 0;
+        uint64_t size = 0;
+        int ret = Z_OK;
+        while (ret != Z_STREAM_END)
+        {
+          inflater.strm.next_out = buffer.data();
+          inflater.strm.avail_out = static_cast<uInt>(buffer.size());
+          while (inflater.strm.avail_out && ret != Z_STREAM_END)
+          {
+            ret = inflater.step(Z_NO_FLUSH);
+          }
+          const auto produced = buffer.size() - inflater.strm.avail_out;
+          crc = static_cast<uint32_t>(crc32(crc, buffer.data(), static_cast<uInt>(produced)));
+          out.write(buffer.data(), produced);
+          size += produced;
+        }
+        if (size != m_local_file_header.uncompressed_size)
+        {
+          throw std::runtime_error("File is corrupt");
+        }
+        return crc;
+      }
+
+      size_t writeEntry(detail::OutputBuffer& out)
+      {
+        auto written = size_t(0);
+        if (m_local_file_header.flags & 0x08)
+        {
+          // The data descriptor of a loaded entry is not copied, the header carries the sizes instead.
+          auto header = m_local_file_header;
+          header.flags &= ~uint16_t(0x08);
+          written = boost::fusion::accumulate(header, written, detail::WriteToBuffer(out));
+        }
+        else
+        {
+          written = boost::fusion::accumulate(m_local_file_header, written, detail::WriteToBuffer(out));
+        }
         if (m_local_file_header.file_name_length)
         {
-          ofOutput.write(m_local_file_header.file_name.data(), m_local_file_header.file_name.size());
+          out.write(m_local_file_header.file_name.data(), m_local_file_header.file_name.size());
           written += m_local_file_header.file_name.size();
         }
         if (m_local_file_header.extra_field_length)
         {
-          ofOutput.write(reinterpret_cast<const char*>(m_local_file_header.extra_field.data()),
-                         m_local_file_header.extra_field.size());
+          out.write(m_local_file_header.extra_field.data(), m_local_file_header.extra_field.size());
           written += m_local_file_header.extra_field.size();
         }
         if (!m_data.empty())
         {
-          ofOutput.write(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+          out.write(m_data.data(), m_data.size());
+          return written + m_data.size();
+        }
+        if (m_mapped)
+        {
+          out.write(m_mapped, m_local_file_header.compressed_size);
+          return written + m_local_file_header.compressed_size;
+        }
+        // Payloads in the staging file or in the source archive are copied through in chunks,
+        // large writes bypass the buffer.
+        const auto read = payloadReader();
+        std::vector<uint8_t> chunk(std::min<size_t>(m_local_file_header.compressed_size, 1 << 20));
+        uint64_t done = 0;
+        while (done < m_local_file_header.compressed_size)
+        {
+          const auto n = read(done, chunk.data(), chunk.size());
+          if (!n)
+          {
+            throw std::runtime_error("Could not read payload");
+          }
+          out.write(chunk.data(), n);
+          done += n;
         }
-        return written + m_data.size();
+        return written + m_local_file_header.compressed_size;
+      }
+
+      /**
+       * The number of bytes writeEntry produces.
+       */
+      auto recordSize() const noexcept -> uint64_t
+      {
+        return local_file_header_size + m_local_file_header.file_name.size() +
+               m_local_file_header.extra_field.size() + m_local_file_header.compressed_size;
+      }
+
+      void stage(const std::shared_ptr<detail::StagingFile>& file)
+      {
+        m_staged_offset = file->append(m_data.data(), m_data.size());
+        m_staging = file;
+        std::vector<uint8_t>{}.swap(m_data);
       }
 
       LocalFileHeader m_local_file_header;
       size_t m_offset;
-      FileRead_fn m_read;
+      std::shared_ptr<const detail::ArchiveSource> m_source;
+      const uint8_t* m_mapped;
+      int m_fd = -1;
       mutable std::vector<uint8_t> m_data;
+      std::shared_ptr<detail::StagingFile> m_staging;
+      uint64_t m_staged_offset = 0;
+      std::weak_ptr<detail::AsyncContext> m_async;
+      detail::AesField m_aes{};
+      std::string m_password;
+      mutable std::mutex m_keys_mutex;
+      mutable std::shared_ptr<const detail::AesKeys> m_keys;
+      mutable std::mutex m_index_mutex;
+      mutable std::shared_ptr<const detail::InflateIndex> m_index;
     };
 
-    ZipEntry::ZipEntry(const LocalFileHeader& lf, size_t offset, FileRead_fn fn)
-      : impl{std::make_unique<ZipEntry::pimpl>(lf, offset, std::move(fn))}
+    ZipEntry::ZipEntry(const LocalFileHeader& lf, size_t offset, std::shared_ptr<const detail::ArchiveSource> source)
+      : impl{std::make_unique<ZipEntry::pimpl>(lf, offset, std::move(source))}
+    {
+    }
+    ZipEntry::ZipEntry(const LocalFileHeader& lf,
+                       const void* data,
+                       std::uint64_t length,
+                       const CompressionOptions& options)
+      : impl{std::make_unique<ZipEntry::pimpl>(lf, data, length, options)}
+    {
+    }
+
+    ZipEntry::ZipEntry(const LocalFileHeader& lf, std::vector<uint8_t>&& data, const CompressionOptions& options)
+      : impl{std::make_unique<ZipEntry::pimpl>(lf, std::move(data), options)}
     {
     }
-    ZipEntry::ZipEntry(const LocalFileHeader& lf, const void* data, std::uint64_t length)
-      : impl{std::make_unique<ZipEntry::pimpl>(lf, data, length)}
+
+    ZipEntry::ZipEntry(const LocalFileHeader& lf,
+                       const void* data,
+                       std::uint64_t length,
+                       const CompressionOptions& options,
+                       std::shared_ptr<detail::StagingFile> staging)
+      : impl{std::make_unique<ZipEntry::pimpl>(lf, data, length, options, std::move(staging))}
+    {
+    }
+
+    ZipEntry::ZipEntry(const LocalFileHeader& lf, const uint8_t* payload)
+      : impl{std::make_unique<ZipEntry::pimpl>(lf, payload)}
+    {
+    }
+
+    ZipEntry::ZipEntry(const LocalFileHeader& lf, std::vector<uint8_t>&& payload)
+      : impl{std::make_unique<ZipEntry::pimpl>(lf, std::move(payload))}
     {
     }
 
+    ZipEntry::ZipEntry(ZipEntry&&) noexcept = default;
+    ZipEntry& ZipEntry::operator=(ZipEntry&&) noexcept = default;
+
     ZipEntry::~ZipEntry()
     {
     }
@@ -180,6 +811,11 @@ namespace cppzip
       return impl->getEntryName();
     }
 
+    auto ZipEntry::getDate() const noexcept -> time_t
+    {
+      return impl->getDate();
+    }
+
     auto ZipEntry::getCompressionMethod() const noexcept -> CompressionMethod
     {
       return impl->getCompressionMethod();
@@ -190,6 +826,16 @@ namespace cppzip
       return impl->getEncryptionMethod();
     }
 
+    bool ZipEntry::isEncrypted() const noexcept
+    {
+      return impl->isEncrypted();
+    }
+
+    void ZipEntry::setPassword(const std::string& password)
+    {
+      impl->setPassword(password);
+    }
+
     auto ZipEntry::getCompressedSize() const noexcept -> uint64_t
     {
       return impl->getCompressedSize();
@@ -230,9 +876,96 @@ namespace cppzip
       return impl->readContent(ofOutput);
     }
 
-    size_t ZipEntry::writeEntry(std::ostream& ofOutput)
+    auto ZipEntry::readContentAsync(const Executor& executor) const -> std::future<std::vector<uint8_t>>
     {
-      return impl->writeEntry(ofOutput);
+      auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+      auto result = promise->get_future();
+      readContentAsync(
+          [promise](std::exception_ptr error, std::vector<uint8_t> data) {
+            if (error)
+            {
+              promise->set_exception(error);
+            }
+            else
+            {
+              promise->set_value(std::move(data));
+            }
+          },
+          executor);
+      return result;
+    }
+
+    void ZipEntry::readContentAsync(ReadContent_fn fn, const Executor& executor) const
+    {
+      auto job = [self = shared_from_this(), fn = std::move(fn)] {
+        std::vector<uint8_t> data;
+        std::exception_ptr error;
+        try
+        {
+          data = self->impl->loadContent();
+        }
+        catch (...)
+        {
+          error = std::current_exception();
+        }
+        fn(error, std::move(data));
+      };
+      if (executor)
+      {
+        executor(std::move(job));
+        return;
+      }
+      const auto context = impl->m_async.lock();
+      if (!context)
+      {
+        throw std::runtime_error("No executor available");
+      }
+      context->post(std::move(job));
+    }
+
+    bool ZipEntry::hasView() const noexcept
+    {
+      return impl->hasView();
+    }
+
+    auto ZipEntry::getView(bool verify) const -> ContentView
+    {
+      return impl->getView(verify);
+    }
+
+    auto ZipEntry::readRange(uint64_t offset, size_t length) const -> std::vector<uint8_t>
+    {
+      return impl->readRange(offset, length);
+    }
+
+    void ZipEntry::buildIndex(uint64_t spacing)
+    {
+      impl->buildIndex(spacing);
+    }
+
+    void ZipEntry::saveIndex(std::ostream& out) const
+    {
+      impl->saveIndex(out);
+    }
+
+    bool ZipEntry::loadIndex(std::istream& in)
+    {
+      return impl->loadIndex(in);
+    }
+
+    auto ZipEntry::extractTo(const boost::filesystem::path& path, bool verify) const -> uint64_t
+    {
+      return impl->extractTo(path, verify);
+    }
+
+    size_t ZipEntry::writeEntry(detail::OutputBuffer& out)
+    {
+      return impl->writeEntry(out);
+    }
+
+    auto ZipEntry::recordSize() const noexcept -> uint64_t
+    {
+      return impl->recordSize();
     }
 
     size_t ZipEntry::compressedSize() const
@@ -240,6 +973,72 @@ namespace cppzip
       return impl->getCompressedSize();
     }
 
+    size_t ZipEntry::dataOffset() const
+    {
+      return impl->m_offset;
+    }
+
+    auto ZipEntry::cachedData() const -> const std::vector<uint8_t>&
+    {
+      return impl->m_data;
+    }
+
+    auto ZipEntry::localHeader() const -> const LocalFileHeader&
+    {
+      return impl->m_local_file_header;
+    }
+
+    auto ZipEntry::decodeContent(const uint8_t* data, size_t length) const -> std::vector<uint8_t>
+    {
+      return impl->decodeContent(data, length);
+    }
+
+    void ZipEntry::setAsyncContext(std::weak_ptr<detail::AsyncContext> context)
+    {
+      impl->m_async = std::move(context);
+    }
+
+    void ZipEntry::encrypt(const EncryptionOptions& options)
+    {
+      impl->encrypt(options);
+    }
+
+    void ZipEntry::setName(const std::string& name)
+    {
+      impl->m_local_file_header.file_name = name;
+      impl->m_local_file_header.file_name_length = static_cast<uint16_t>(name.size());
+    }
+
+    void ZipEntry::relocate(size_t offset) noexcept
+    {
+      impl->m_offset = offset;
+    }
+
+    void ZipEntry::stage(const std::shared_ptr<detail::StagingFile>& file)
+    {
+      impl->stage(file);
+    }
+
+    bool ZipEntry::isStaged() const noexcept
+    {
+      return impl->m_staging != nullptr;
+    }
+
+    bool ZipEntry::isInSource() const noexcept
+    {
+      return impl->m_source != nullptr;
+    }
+
+    auto ZipEntry::loadContent() const -> std::vector<uint8_t>
+    {
+      return impl->loadContent();
+    }
+
+    auto ZipEntry::payloadReader() const -> std::function<size_t(uint64_t, uint8_t*, size_t)>
+    {
+      return impl->payloadReader();
+    }
+
   } // namespace v1
 } // namespace cppzip
 
@@ -0,0 +1,271 @@
+/**
+ * \file zip_overlay.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <cppzip/v1/zip_overlay.h>
+#include <list>
+#include <mutex>
+#include <path_index.h>
+#include <shared_mutex>
+
+namespace cppzip
+{
+  inline namespace v1
+  {
+    namespace
+    {
+      /**
+       * A mounted archive. The sorted names answer which archive is next in line when one
+       * above it is unmounted, without opening anything.
+       */
+      struct Mount
+      {
+        boost::filesystem::path path;
+        std::vector<std::string> names;
+        std::shared_ptr<ZipArchive> archive;
+        std::list<Mount*>::iterator lru;
+
+        bool contains(const std::string& name) const
+        {
+          return std::binary_search(names.begin(), names.end(), name);
+        }
+      };
+    } // namespace
+
+    struct ZipOverlay::pimpl
+    {
+      explicit pimpl(const OverlayOptions& options) : m_options{options}
+      {
+        if (m_options.mode != ZipArchive::OpenMode::ReadOnly && m_options.mode != ZipArchive::OpenMode::Mapped)
+        {
+          throw std::runtime_error("Overlay archives must be opened read only");
+        }
+        m_options.max_open_archives = std::max<size_t>(m_options.max_open_archives, 1);
+      }
+
+      bool mount(const boost::filesystem::path& path)
+      {
+        std::unique_lock<std::shared_timed_mutex> lock(m_index_mutex);
+        if (find(path) != m_mounts.end())
+        {
+          return false;
+        }
+        auto archive = std::make_shared<ZipArchive>(path, m_options.mode);
+        std::unique_ptr<Mount> mount{new Mount{path, archive->getSnapshot().names, {}, {}}};
+        std::sort(mount->names.begin(), mount->names.end());
+        for (const auto& name : mount->names)
+        {
+          m_index.assign(name, mount.get());
+        }
+        m_mounts.push_back(std::move(mount));
+        std::lock_guard<std::mutex> pool(m_pool_mutex);
+        cache(*m_mounts.back(), std::move(archive));
+        return true;
+      }
+
+      bool unmount(const boost::filesystem::path& path)
+      {
+        std::unique_lock<std::shared_timed_mutex> lock(m_index_mutex);
+        const auto iter = find(path);
+        if (iter == m_mounts.end())
+        {
+          return false;
+        }
+        Mount* mount = iter->get();
+        // Only the names this archive provided change owner, to the next archive below it.
+        for (const auto& name : mount->names)
+        {
+          const auto* owner = m_index.find(name);
+          if (!owner || *owner != mount)
+          {
+            continue;
+          }
+          const auto below = std::find_if(std::make_reverse_iterator(iter), m_mounts.rend(),
+                                          [&name](const std::unique_ptr<Mount>& m) { return m->contains(name); });
+          if (below == m_mounts.rend())
+          {
+            m_index.erase(name);
+          }
+          else
+          {
+            m_index.assign(name, below->get());
+          }
+        }
+        {
+          std::lock_guard<std::mutex> pool(m_pool_mutex);
+          if (mount->archive)
+          {
+            m_lru.erase(mount->lru);
+          }
+        }
+        m_mounts.erase(iter);
+        return true;
+      }
+
+      auto getMounts() const -> std::vector<boost::filesystem::path>
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(m_index_mutex);
+        std::vector<boost::filesystem::path> result;
+        for (const auto& m : m_mounts)
+        {
+          result.push_back(m->path);
+        }
+        return result;
+      }
+
+      auto getNumberOfEntries() const -> size_t
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(m_index_mutex);
+        return m_index.size();
+      }
+
+      auto hasEntry(const std::string& name) const -> bool
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(m_index_mutex);
+        return m_index.find(name) != nullptr;
+      }
+
+      auto getArchivePath(const std::string& name) const -> boost::filesystem::path
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(m_index_mutex);
+        const auto* owner = m_index.find(name);
+        return owner ? (*owner)->path : boost::filesystem::path{};
+      }
+
+      auto getEntry(const std::string& name) const -> ZipEntryPtr
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(m_index_mutex);
+        const auto* owner = m_index.find(name);
+        if (!owner)
+        {
+          return nullptr;
+        }
+        return acquire(**owner)->getEntry(name);
+      }
+
+      auto listDirectory(const std::string& directory) const -> std::vector<std::string>
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(m_index_mutex);
+        return m_index.children(directory);
+      }
+
+      auto findEntries(const std::string& pattern) const -> std::vector<std::string>
+      {
+        std::shared_lock<std::shared_timed_mutex> lock(m_index_mutex);
+        std::vector<std::string> result;
+        m_index.match(pattern, [&result](const std::string& name, Mount*) { result.push_back(name); });
+        return result;
+      }
+
+      auto find(const boost::filesystem::path& path) -> std::vector<std::unique_ptr<Mount>>::iterator
+      {
+        return std::find_if(m_mounts.begin(), m_mounts.end(),
+                            [&path](const std::unique_ptr<Mount>& m) { return m->path == path; });
+      }
+
+      /**
+       * Returns the open archive of the mount, opening it again if the pool closed it.
+       */
+      auto acquire(Mount& mount) const -> std::shared_ptr<ZipArchive>
+      {
+        {
+          std::lock_guard<std::mutex> pool(m_pool_mutex);
+          if (mount.archive)
+          {
+            m_lru.splice(m_lru.begin(), m_lru, mount.lru);
+            return mount.archive;
+          }
+        }
+        // Opening parses the directory, which is done outside of the pool lock.
+        auto archive = std::make_shared<ZipArchive>(mount.path, m_options.mode);
+        std::lock_guard<std::mutex> pool(m_pool_mutex);
+        if (mount.archive)
+        {
+          return mount.archive;
+        }
+        cache(mount, archive);
+        return archive;
+      }
+
+      /**
+       * Adds an opened archive to the pool and closes the least recently used ones beyond
+       * the limit. Entries handed out keep their handles until they are released.
+       */
+      void cache(Mount& mount, std::shared_ptr<ZipArchive> archive) const
+      {
+        mount.archive = std::move(archive);
+        m_lru.push_front(&mount);
+        mount.lru = m_lru.begin();
+        while (m_lru.size() > m_options.max_open_archives)
+        {
+          m_lru.back()->archive.reset();
+          m_lru.pop_back();
+        }
+      }
+
+      OverlayOptions m_options;
+      mutable std::shared_timed_mutex m_index_mutex;
+      mutable std::mutex m_pool_mutex;
+      mutable std::list<Mount*> m_lru;
+      std::vector<std::unique_ptr<Mount>> m_mounts;
+      detail::PathIndex<Mount*> m_index;
+    };
+
+    ZipOverlay::ZipOverlay(const OverlayOptions& options) : impl{std::make_unique<ZipOverlay::pimpl>(options)}
+    {
+    }
+
+    ZipOverlay::~ZipOverlay() = default;
+    ZipOverlay::ZipOverlay(ZipOverlay&&) noexcept = default;
+    ZipOverlay& ZipOverlay::operator=(ZipOverlay&&) noexcept = default;
+
+    bool ZipOverlay::mount(const boost::filesystem::path& path)
+    {
+      return impl->mount(path);
+    }
+
+    bool ZipOverlay::unmount(const boost::filesystem::path& path)
+    {
+      return impl->unmount(path);
+    }
+
+    auto ZipOverlay::getMounts() const -> std::vector<boost::filesystem::path>
+    {
+      return impl->getMounts();
+    }
+
+    auto ZipOverlay::getNumberOfEntries() const -> size_t
+    {
+      return impl->getNumberOfEntries();
+    }
+
+    auto ZipOverlay::hasEntry(const std::string& name) const -> bool
+    {
+      return impl->hasEntry(name);
+    }
+
+    auto ZipOverlay::getArchivePath(const std::string& name) const -> boost::filesystem::path
+    {
+      return impl->getArchivePath(name);
+    }
+
+    auto ZipOverlay::getEntry(const std::string& name) const -> ZipEntryPtr
+    {
+      return impl->getEntry(name);
+    }
+
+    auto ZipOverlay::listDirectory(const std::string& directory) const -> std::vector<std::string>
+    {
+      return impl->listDirectory(directory);
+    }
+
+    auto ZipOverlay::findEntries(const std::string& pattern) const -> std::vector<std::string>
+    {
+      return impl->findEntries(pattern);
+    }
+  } // namespace v1
+} // namespace cppzip
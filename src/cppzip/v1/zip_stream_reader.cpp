@@ -0,0 +1,697 @@
+/**
+ * \file zip_stream_reader.cpp
+ */
+//		Copyright Michael Kaes 2017.
+//		Distributed under rhe MIT License.
+//		(See accompanying file LICENSE)
+
+#include <algorithm>
+#include <boost/fusion/include/for_each.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <central_directory_file_header.h>
+#include <cppzip/v1/zip_stream_reader.h>
+#include <cstring>
+#include <digital_signature.h>
+#include <end_of_central_directory_record.h>
+#include <helper.h>
+#include <initializer_list>
+#include <limits>
+#include <local_file_header.h>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <zip_functions.h>
+#include <zlib.h>
+
+namespace cppzip
+{
+  inline namespace v1
+  {
+    namespace
+    {
+      constexpr size_t stream_chunk_size = 1 << 16;
+
+      /**
+       * The remaining payload of a deflated entry whose size follows in a data descriptor.
+       */
+      constexpr uint64_t unknown_size = std::numeric_limits<uint64_t>::max();
+
+      uint32_t readSignature(const uint8_t* data)
+      {
+        uint32_t signature;
+        detail::ReadFromArray{data}(signature);
+        return signature;
+      }
+
+      constexpr uint32_t zip64_marker = 0xFFFFFFFF;
+      constexpr uint16_t zip64_extra_id = 0x0001;
+      constexpr uint32_t zip64_end_of_central_directory_signature = 0x06064b50;
+      constexpr uint32_t zip64_end_of_central_directory_locator_signature = 0x07064b50;
+      constexpr size_t zip64_end_of_central_directory_locator_size = 20;
+
+      /**
+       * Returns the zip64 extended information of an extra field, or nullptr if there is none.
+       */
+      auto findZip64(const std::vector<uint8_t>& extra, uint16_t& size) -> const uint8_t*
+      {
+        for (size_t pos = 0; pos + 4 <= extra.size();)
+        {
+          uint16_t id, length;
+          detail::ReadFromArray read{extra.data() + pos};
+          read(id);
+          read(length);
+          if (pos + 4 + length > extra.size())
+          {
+            break;
+          }
+          if (id == zip64_extra_id)
+          {
+            size = length;
+            return extra.data() + pos + 4;
+          }
+          pos += 4 + length;
+        }
+        return nullptr;
+      }
+
+      /**
+       * Replaces the fields marked as too large for 32 bit with the values of the zip64 extra
+       * field, which lists them in the order of the arguments.
+       */
+      void readZip64(const std::vector<uint8_t>& extra, std::initializer_list<std::pair<uint32_t, uint64_t*>> fields)
+      {
+        uint16_t size = 0;
+        const auto* data = findZip64(extra, size);
+        for (const auto& field : fields)
+        {
+          *field.second = field.first;
+          if (field.first == zip64_marker && data && size >= 8)
+          {
+            detail::ReadFromArray{data}(*field.second);
+            data += 8;
+            size -= 8;
+          }
+        }
+      }
+
+      /**
+       * What the local headers said about an entry, to check the central directory against.
+       */
+      struct SeenEntry
+      {
+        std::string name;
+        uint32_t crc32;
+        uint64_t compressed_size;
+        uint64_t uncompressed_size;
+      };
+    } // namespace
+
+    struct ZipStreamReader::pimpl
+    {
+      /**
+       * Adapts the content of the current entry to boost iostreams.
+       */
+      struct EntrySource
+      {
+        using char_type = char;
+        using category = boost::iostreams::source_tag;
+
+        std::streamsize read(char* s, std::streamsize n)
+        {
+          const auto got = reader->read(s, static_cast<size_t>(n));
+          return got ? static_cast<std::streamsize>(got) : -1;
+        }
+
+        pimpl* reader;
+      };
+
+      explicit pimpl(std::istream& input) : m_input{input}, m_buffer(stream_chunk_size)
+      {
+        std::memset(&m_strm, 0, sizeof(m_strm));
+        if (inflateInit2(&m_strm, -MAX_WBITS) != Z_OK)
+        {
+          throw std::runtime_error("Could not initialize inflate");
+        }
+      }
+
+      ~pimpl()
+      {
+        inflateEnd(&m_strm);
+      }
+
+      bool next()
+      {
+        if (m_done)
+        {
+          return false;
+        }
+        if (m_active)
+        {
+          skipEntry();
+          m_active = false;
+        }
+        m_stream.reset();
+        if (!fill(4))
+        {
+          m_done = true;
+          return false;
+        }
+        const auto signature = readSignature(m_buffer.data() + m_begin);
+        if (signature == local_file_header_signature)
+        {
+          readLocalHeader();
+          return true;
+        }
+        if (signature == central_directory_file_header_signature ||
+            signature == static_cast<uint32_t>(end_of_central_directory_signature))
+        {
+          readCentralDirectory();
+          m_done = true;
+          return false;
+        }
+        throw std::runtime_error("Unexpected signature in archive");
+      }
+
+      auto getEntryName() const -> std::string
+      {
+        return m_header.file_name;
+      }
+
+      auto getDate() const noexcept -> time_t
+      {
+        const uint16_t date = m_header.file_modification >> 16 & 0xFFFF;
+        const uint16_t time = m_header.file_modification & 0xFFFF;
+        return datetime_to_timestamp(date, time);
+      }
+
+      auto getCompressionMethod() const noexcept -> CompressionMethod
+      {
+        return static_cast<CompressionMethod>(m_header.compression_method);
+      }
+
+      bool hasDataDescriptor() const noexcept
+      {
+        return (m_header.flags & 0x08) != 0;
+      }
+
+      auto getCompressedSize() const noexcept -> uint64_t
+      {
+        return m_compressed_size;
+      }
+
+      auto getUncompressedSize() const noexcept -> uint64_t
+      {
+        return m_uncompressed_size;
+      }
+
+      auto getCRC() const noexcept -> uint32_t
+      {
+        return m_header.crc32;
+      }
+
+      bool isDirectory() const noexcept
+      {
+        return !m_header.file_name.empty() && m_header.file_name.back() == '/';
+      }
+
+      auto read(void* buffer, size_t length) -> size_t
+      {
+        if (!m_active || m_finished || !length)
+        {
+          return 0;
+        }
+        if (m_header.flags & 0x01)
+        {
+          throw std::runtime_error("Encrypted entries are not supported");
+        }
+        auto* out = reinterpret_cast<uint8_t*>(buffer);
+        size_t produced = 0;
+        switch (getCompressionMethod())
+        {
+        case CompressionMethod::no:
+          while (produced < length && m_remaining)
+          {
+            if (!available() && !fill(1))
+            {
+              throw std::runtime_error("Unexpected end of archive");
+            }
+            const auto n = static_cast<size_t>(std::min<uint64_t>({length - produced, m_remaining, available()}));
+            std::memcpy(out + produced, m_buffer.data() + m_begin, n);
+            consume(n);
+            produced += n;
+          }
+          break;
+        case CompressionMethod::defalted:
+          m_strm.next_out = out;
+          m_strm.avail_out = static_cast<uInt>(std::min<size_t>(length, std::numeric_limits<uInt>::max()));
+          while (m_strm.avail_out && !m_stream_end)
+          {
+            // With the payload consumed inflate may still hold output, e.g. the rest of a match.
+            uInt in = 0;
+            if (m_remaining)
+            {
+              if (!available() && !fill(1))
+              {
+                throw std::runtime_error("Unexpected end of archive");
+              }
+              in = static_cast<uInt>(std::min<uint64_t>(available(), m_remaining));
+            }
+            m_strm.next_in = m_buffer.data() + m_begin;
+            m_strm.avail_in = in;
+            const auto space = m_strm.avail_out;
+            const int ret = inflate(&m_strm, Z_NO_FLUSH);
+            consume(in - m_strm.avail_in);
+            if (ret == Z_STREAM_END)
+            {
+              m_stream_end = true;
+            }
+            else if (ret != Z_OK && ret != Z_BUF_ERROR)
+            {
+              throw std::runtime_error("File is corrupt");
+            }
+            else if (!in && m_strm.avail_out == space)
+            {
+              // The output produced so far is returned first, the next call fails.
+              if (m_strm.next_out == out)
+              {
+                throw std::runtime_error("Unexpected end of deflate stream");
+              }
+              break;
+            }
+          }
+          produced = static_cast<size_t>(m_strm.next_out - out);
+          break;
+        default:
+          throw std::runtime_error("Compression method not supported");
+        }
+        m_crc.process_bytes(out, produced);
+        m_produced += produced;
+        if (getCompressionMethod() == CompressionMethod::defalted ? m_stream_end : !m_remaining)
+        {
+          finishEntry(true);
+        }
+        return produced;
+      }
+
+      auto readContent(std::ostream& ofOutput) -> int64_t
+      {
+        std::vector<char> chunk(stream_chunk_size);
+        int64_t total = 0;
+        while (const auto n = read(chunk.data(), chunk.size()))
+        {
+          ofOutput.write(chunk.data(), n);
+          total += n;
+        }
+        return total;
+      }
+
+      auto getStream() -> std::istream&
+      {
+        if (!m_stream)
+        {
+          m_stream.reset(new boost::iostreams::stream<EntrySource>(EntrySource{this}));
+          // Corrupt content must not look like a short entry.
+          m_stream->exceptions(std::ios::badbit);
+        }
+        return *m_stream;
+      }
+
+      bool hasCentralDirectory() const noexcept
+      {
+        return m_central_directory;
+      }
+
+    private:
+      auto available() const noexcept -> size_t
+      {
+        return m_end - m_begin;
+      }
+
+      /**
+       * Makes sure count bytes are buffered. Blocks only for the missing bytes and takes
+       * whatever else has already arrived. Returns false at the end of the input.
+       */
+      bool fill(size_t count)
+      {
+        if (available() >= count)
+        {
+          return true;
+        }
+        if (m_begin)
+        {
+          std::memmove(m_buffer.data(), m_buffer.data() + m_begin, available());
+          m_end -= m_begin;
+          m_begin = 0;
+        }
+        if (m_buffer.size() < count)
+        {
+          m_buffer.resize(count);
+        }
+        m_input.read(reinterpret_cast<char*>(m_buffer.data() + m_end), static_cast<std::streamsize>(count - m_end));
+        m_end += static_cast<size_t>(m_input.gcount());
+        if (m_end < count)
+        {
+          return false;
+        }
+        // in_avail is -1 for some pipes and readsome would then flag the end of the input.
+        if (m_input.rdbuf()->in_avail() > 0)
+        {
+          m_end += static_cast<size_t>(m_input.readsome(reinterpret_cast<char*>(m_buffer.data() + m_end),
+                                                        static_cast<std::streamsize>(m_buffer.size() - m_end)));
+        }
+        return true;
+      }
+
+      /**
+       * Returns count buffered bytes which are then no longer part of the input.
+       */
+      auto take(size_t count) -> const uint8_t*
+      {
+        if (!fill(count))
+        {
+          throw std::runtime_error("Unexpected end of archive");
+        }
+        const auto* data = m_buffer.data() + m_begin;
+        m_begin += count;
+        m_position += count;
+        return data;
+      }
+
+      /**
+       * Drops count bytes of the input which may exceed the buffer.
+       */
+      void skip(uint64_t count)
+      {
+        while (count)
+        {
+          if (!available() && !fill(1))
+          {
+            throw std::runtime_error("Unexpected end of archive");
+          }
+          const auto n = static_cast<size_t>(std::min<uint64_t>(available(), count));
+          take(n);
+          count -= n;
+        }
+      }
+
+      /**
+       * Consumes count bytes of the payload of the current entry.
+       */
+      void consume(size_t count)
+      {
+        m_begin += count;
+        m_position += count;
+        m_compressed += count;
+        if (m_remaining != unknown_size)
+        {
+          m_remaining -= count;
+        }
+      }
+
+      void readLocalHeader()
+      {
+        m_header_offset = m_position;
+        LocalFileHeader header;
+        boost::fusion::for_each(header, detail::ReadFromArray(take(local_file_header_size)));
+        if (header.file_name_length)
+        {
+          header.file_name.assign(reinterpret_cast<const char*>(take(header.file_name_length)),
+                                  header.file_name_length);
+        }
+        if (header.extra_field_length)
+        {
+          const auto* extra = take(header.extra_field_length);
+          header.extra_field.assign(extra, extra + header.extra_field_length);
+        }
+        uint16_t zip64_size = 0;
+        m_zip64 = findZip64(header.extra_field, zip64_size) != nullptr;
+        readZip64(header.extra_field,
+                  {{header.uncompressed_size, &m_uncompressed_size}, {header.compressed_size, &m_compressed_size}});
+        m_header = std::move(header);
+        m_active = true;
+        m_finished = false;
+        m_stream_end = false;
+        m_compressed = 0;
+        m_produced = 0;
+        m_crc.reset();
+        m_remaining = m_compressed_size;
+
+        const bool deflated = getCompressionMethod() == CompressionMethod::defalted;
+        if (hasDataDescriptor() && !m_compressed_size)
+        {
+          // Only a deflate stream tells where it ends.
+          if (deflated && !(m_header.flags & 0x01))
+          {
+            m_remaining = unknown_size;
+          }
+          else if (!isDirectory())
+          {
+            throw std::runtime_error("Size of entry " + m_header.file_name + " is unknown");
+          }
+        }
+        if (deflated)
+        {
+          inflateReset(&m_strm);
+        }
+        if (!m_remaining)
+        {
+          finishEntry(true);
+        }
+      }
+
+      void skipEntry()
+      {
+        if (m_finished)
+        {
+          return;
+        }
+        if (m_remaining == unknown_size)
+        {
+          // The end of the payload is only found by inflating it.
+          std::vector<uint8_t> discard(stream_chunk_size);
+          while (read(discard.data(), discard.size()))
+          {
+          }
+          return;
+        }
+        finishEntry(false);
+      }
+
+      void finishEntry(bool verify)
+      {
+        m_finished = true;
+        // Skips the payload which was not read, or which follows the end of the deflate stream.
+        while (m_remaining && m_remaining != unknown_size)
+        {
+          if (!available() && !fill(1))
+          {
+            throw std::runtime_error("Unexpected end of archive");
+          }
+          consume(static_cast<size_t>(std::min<uint64_t>(available(), m_remaining)));
+        }
+        if (hasDataDescriptor())
+        {
+          // The signature of the data descriptor is optional.
+          if (fill(4) && readSignature(m_buffer.data() + m_begin) == data_descriptor_signature)
+          {
+            take(4);
+          }
+          // With a zip64 extra field the sizes take 8 bytes each.
+          detail::ReadFromArray read{take(m_zip64 ? data_descriptor_size + 8 : data_descriptor_size)};
+          read(m_header.crc32);
+          if (m_zip64)
+          {
+            read(m_compressed_size);
+            read(m_uncompressed_size);
+          }
+          else
+          {
+            read(m_header.compressed_size);
+            read(m_header.uncompressed_size);
+            m_compressed_size = m_header.compressed_size;
+            m_uncompressed_size = m_header.uncompressed_size;
+          }
+          if (m_compressed_size != m_compressed)
+          {
+            throw std::runtime_error("Data descriptor does not match entry " + m_header.file_name);
+          }
+        }
+        if (verify && (m_produced != m_uncompressed_size || m_crc.checksum() != m_header.crc32))
+        {
+          throw std::runtime_error("File is corrupt");
+        }
+        // Keyed by offset, an archive may hold several records of the same name.
+        m_seen[m_header_offset] = SeenEntry{m_header.file_name, m_header.crc32, m_compressed_size, m_uncompressed_size};
+      }
+
+      void readCentralDirectory()
+      {
+        size_t count = 0;
+        for (;;)
+        {
+          if (!fill(4))
+          {
+            throw std::runtime_error("Unexpected end of archive");
+          }
+          const auto signature = readSignature(m_buffer.data() + m_begin);
+          if (signature == central_directory_file_header_signature)
+          {
+            CentralDirectoryFileHeader header;
+            boost::fusion::for_each(header, detail::ReadFromArray(take(central_directory_file_header_size)));
+            header.file_name.assign(reinterpret_cast<const char*>(take(header.file_name_length)),
+                                    header.file_name_length);
+            const auto* extra = take(header.extra_field_length);
+            header.extra_field.assign(extra, extra + header.extra_field_length);
+            take(header.file_comment_lenght);
+            SeenEntry listed{header.file_name, header.crc32, 0, 0};
+            uint64_t offset = 0;
+            readZip64(header.extra_field,
+                      {{header.uncompressed_size, &listed.uncompressed_size},
+                       {header.compressed_size, &listed.compressed_size},
+                       {header.offset_of_local_header, &offset}});
+            const auto seen = m_seen.find(offset);
+            if (seen == m_seen.end())
+            {
+              throw std::runtime_error("Central directory lists missing entry " + header.file_name);
+            }
+            if (seen->second.name != listed.name || seen->second.crc32 != listed.crc32 ||
+                seen->second.compressed_size != listed.compressed_size ||
+                seen->second.uncompressed_size != listed.uncompressed_size)
+            {
+              throw std::runtime_error("Central directory does not match entry " + header.file_name);
+            }
+            ++count;
+          }
+          else if (signature == digital_signature_signature)
+          {
+            DigitalSignature digital_signature;
+            boost::fusion::for_each(digital_signature, detail::ReadFromArray(take(digital_signature_size)));
+            skip(digital_signature.size);
+          }
+          else if (signature == zip64_end_of_central_directory_signature)
+          {
+            uint64_t size;
+            detail::ReadFromArray{take(12) + 4}(size);
+            skip(size);
+          }
+          else if (signature == zip64_end_of_central_directory_locator_signature)
+          {
+            take(zip64_end_of_central_directory_locator_size);
+          }
+          else if (signature == static_cast<uint32_t>(end_of_central_directory_signature))
+          {
+            EndOfCentralDirectoryRecord record;
+            boost::fusion::for_each(record, detail::ReadFromArray(take(end_of_central_directory_size)));
+            // A zip64 archive may leave the count to its own end record.
+            if ((record.total_entries != 0xFFFF && record.total_entries != count) || count != m_seen.size())
+            {
+              throw std::runtime_error("Central directory does not match the entries");
+            }
+            m_central_directory = true;
+            return;
+          }
+          else
+          {
+            throw std::runtime_error("Unexpected signature in central directory");
+          }
+        }
+      }
+
+      std::istream& m_input;
+      std::vector<uint8_t> m_buffer;
+      size_t m_begin = 0;
+      size_t m_end = 0;
+      uint64_t m_position = 0;
+
+      LocalFileHeader m_header{};
+      uint64_t m_header_offset = 0;
+      uint64_t m_compressed_size = 0;
+      uint64_t m_uncompressed_size = 0;
+      bool m_zip64 = false;
+      bool m_active = false;
+      bool m_finished = true;
+      bool m_stream_end = false;
+      uint64_t m_remaining = 0;
+      uint64_t m_compressed = 0;
+      uint64_t m_produced = 0;
+      boost::crc_32_type m_crc;
+      z_stream m_strm;
+      std::unique_ptr<boost::iostreams::stream<EntrySource>> m_stream;
+
+      bool m_done = false;
+      bool m_central_directory = false;
+      std::map<uint64_t, SeenEntry> m_seen;
+    };
+
+    ZipStreamReader::ZipStreamReader(std::istream& input) : impl{std::make_unique<pimpl>(input)}
+    {
+    }
+
+    ZipStreamReader::~ZipStreamReader() = default;
+
+    bool ZipStreamReader::next()
+    {
+      return impl->next();
+    }
+
+    auto ZipStreamReader::getEntryName() const -> std::string
+    {
+      return impl->getEntryName();
+    }
+
+    auto ZipStreamReader::getDate() const noexcept -> time_t
+    {
+      return impl->getDate();
+    }
+
+    auto ZipStreamReader::getCompressionMethod() const noexcept -> CompressionMethod
+    {
+      return impl->getCompressionMethod();
+    }
+
+    bool ZipStreamReader::hasDataDescriptor() const noexcept
+    {
+      return impl->hasDataDescriptor();
+    }
+
+    auto ZipStreamReader::getCompressedSize() const noexcept -> uint64_t
+    {
+      return impl->getCompressedSize();
+    }
+
+    auto ZipStreamReader::getUncompressedSize() const noexcept -> uint64_t
+    {
+      return impl->getUncompressedSize();
+    }
+
+    auto ZipStreamReader::getCRC() const noexcept -> uint32_t
+    {
+      return impl->getCRC();
+    }
+
+    bool ZipStreamReader::isDirectory() const noexcept
+    {
+      return impl->isDirectory();
+    }
+
+    auto ZipStreamReader::read(void* buffer, size_t length) -> size_t
+    {
+      return impl->read(buffer, length);
+    }
+
+    auto ZipStreamReader::readContent(std::ostream& ofOutput) -> int64_t
+    {
+      return impl->readContent(ofOutput);
+    }
+
+    auto ZipStreamReader::getStream() -> std::istream&
+    {
+      return impl->getStream();
+    }
+
+    bool ZipStreamReader::hasCentralDirectory() const noexcept
+    {
+      return impl->hasCentralDirectory();
+    }
+  } // namespace v1
+} // namespace cppzip
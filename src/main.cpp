@@ -1,9 +1,1336 @@
+#include <cppzip/dos_time.h>
+#include <cppzip/random_access_source.h>
 #include <cppzip/zip_archive.h>
 #include <cppzip/zip_entry.h>
+#include <cppzip/zip_overlay.h>
+#include <cppzip/zip_stream_reader.h>
+#include <algorithm>
+#ifndef _WIN32
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <unistd.h>
+#endif
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <zlib.h>
 
+namespace
+{
+  int failures = 0;
+
+  void check(bool condition, const std::string& what)
+  {
+    if (!condition)
+    {
+      std::cout << "FAILED: " << what << "\n";
+      ++failures;
+    }
+  }
+
+  /**
+   * Runs a group of checks, an exception counts as a failure.
+   */
+  void run(void (*checks)(), const std::string& name)
+  {
+    try
+    {
+      checks();
+    }
+    catch (const std::exception& e)
+    {
+      check(false, name + " threw: " + e.what());
+    }
+  }
+
+  /**
+   * Serves an archive from memory like a remote store, every read is delayed and counted.
+   */
+  class SlowSource final : public cppzip::RandomAccessSource
+  {
+  public:
+    SlowSource(std::vector<uint8_t> data, std::chrono::milliseconds delay) : m_data{std::move(data)}, m_delay{delay}
+    {
+    }
+
+    auto size() const -> uint64_t override
+    {
+      return m_data.size();
+    }
+
+    auto readAt(uint64_t offset, uint8_t* buffer, size_t length) const -> size_t override
+    {
+      ++m_calls;
+      std::this_thread::sleep_for(m_delay);
+      if (offset >= m_data.size())
+      {
+        return 0;
+      }
+      length = std::min<size_t>(length, m_data.size() - offset);
+      std::memcpy(buffer, m_data.data() + offset, length);
+      return length;
+    }
+
+    auto calls() const -> unsigned
+    {
+      return m_calls;
+    }
+
+  private:
+    std::vector<uint8_t> m_data;
+    std::chrono::milliseconds m_delay;
+    mutable std::atomic<unsigned> m_calls{0};
+  };
+
+  auto content(int i, size_t length) -> std::string
+  {
+    std::string result;
+    while (result.size() < length)
+    {
+      result += "entry " + std::to_string(i) + " line " + std::to_string(result.size()) + "\n";
+    }
+    result.resize(length);
+    return result;
+  }
+
+  auto read(const cppzip::ZipEntryPtr& entry) -> std::string
+  {
+    std::ostringstream out;
+    entry->readContent(out);
+    return out.str();
+  }
+
+  void checkAsyncRead()
+  {
+    cppzip::ZipArchive z;
+    const auto text = content(1, 100000);
+    z.addData("async.txt", text.data(), text.size());
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    const auto result = r.getEntry("async.txt")->readContentAsync().get();
+    check(std::string(result.begin(), result.end()) == text, "readContentAsync returns the content");
+
+    std::atomic<bool> done{false};
+    {
+      auto archive = std::make_shared<cppzip::ZipArchive>();
+      archive->addData("x.txt", "x", 1);
+      const auto entry = archive->getEntry("x.txt");
+      auto holder = std::make_shared<std::shared_ptr<cppzip::ZipArchive>>(std::move(archive));
+      // The callback drops the last reference to the archive and its pool.
+      entry->readContentAsync([holder, &done](std::exception_ptr, std::vector<uint8_t>) {
+        holder->reset();
+        done = true;
+      });
+    }
+    while (!done)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  auto names(const std::vector<cppzip::ZipEntryPtr>& entries) -> std::vector<std::string>
+  {
+    std::vector<std::string> result;
+    for (const auto& entry : entries)
+    {
+      result.push_back(entry->getEntryName());
+    }
+    return result;
+  }
+
+  void checkPathIndex()
+  {
+    cppzip::ZipArchive z;
+    for (const auto name : {"src/a.cpp", "src/b.h", "src/sub/c.cpp", "src/sub/deep/d.cpp", "src-extra/e.cpp", "readme"})
+    {
+      z.addData(name, name, std::strlen(name));
+    }
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+
+    using Names = std::vector<std::string>;
+    check(r.listDirectory("") == Names{"readme", "src-extra/", "src/"}, "listDirectory of the root");
+    check(r.listDirectory("src") == Names{"src/a.cpp", "src/b.h", "src/sub/"}, "listDirectory skips sub trees");
+    check(names(r.walkDirectory("src/sub/")) == Names{"src/sub/c.cpp", "src/sub/deep/", "src/sub/deep/d.cpp"},
+          "walkDirectory returns the sub tree in name order");
+    check(names(r.findEntries("src/*.cpp")) == Names{"src/a.cpp"}, "'*' stays within one component");
+    check(names(r.findEntries("src/?.h")) == Names{"src/b.h"}, "'?' matches one character");
+    check(names(r.findEntries("src/**/*.cpp")) == Names{"src/a.cpp", "src/sub/c.cpp", "src/sub/deep/d.cpp"},
+          "'**' matches across components");
+    check(names(r.findEntries("*/e.cpp")) == Names{"src-extra/e.cpp"}, "glob with a leading wildcard");
+  }
+
+  void patch(std::string& data, size_t offset, uint64_t value, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i)
+    {
+      data[offset + i] = static_cast<char>(value >> (8 * i));
+    }
+  }
+
+  void checkInflateIndex()
+  {
+    cppzip::ZipArchive z;
+    const auto text = content(5, 3 << 20);
+    z.addData("big.txt", text.data(), text.size());
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    const auto entry = r.getEntry("big.txt");
+    entry->buildIndex(256 << 10);
+    std::ostringstream saved;
+    entry->saveIndex(saved);
+    const auto range = entry->readRange(2000000, 5000);
+    check(std::string(range.begin(), range.end()) == text.substr(2000000, 5000), "readRange with a built index");
+
+    // The header takes 28 bytes with the point count at 20. Each point is out, in, bits and the
+    // window size, followed by the window. The first point has no window.
+    const auto index = saved.str();
+    const size_t first = 28;
+    const size_t second = first + 21;
+    check(index.size() > second + 21 + 32768, "the index has more than one access point");
+    const auto loads = [&r](const std::string& bytes) {
+      std::istringstream in(bytes);
+      return r.getEntry("big.txt")->loadIndex(in);
+    };
+    check(loads(index), "loadIndex accepts a saved index");
+    auto corrupt = index;
+    patch(corrupt, 20, 0, 8);
+    check(!loads(corrupt.substr(0, first)), "loadIndex rejects an index without points");
+    corrupt = index;
+    patch(corrupt, first, 1, 8);
+    check(!loads(corrupt), "loadIndex rejects a first point which is not the start of the stream");
+    corrupt = index;
+    patch(corrupt, first + 16, 3, 1);
+    check(!loads(corrupt), "loadIndex rejects bits before the start of the stream");
+    corrupt = index;
+    patch(corrupt, second, 0, 8);
+    check(!loads(corrupt), "loadIndex rejects points out of order");
+    corrupt = index;
+    patch(corrupt, second + 8, 0, 8);
+    check(!loads(corrupt), "loadIndex rejects a point at the input offset of the one before");
+    check(!loads(index.substr(0, index.size() - 1)), "loadIndex rejects a truncated index");
+
+    cppzip::ZipArchive other(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    std::istringstream in(index);
+    check(other.getEntry("big.txt")->loadIndex(in), "a saved index loads into another archive");
+    const auto loaded = other.getEntry("big.txt")->readRange(3000000, 100000);
+    check(std::string(loaded.begin(), loaded.end()) == text.substr(3000000, 100000), "readRange with a loaded index");
+  }
+
+  template<typename F>
+  bool throws(F&& f)
+  {
+    try
+    {
+      f();
+    }
+    catch (const std::exception&)
+    {
+      return true;
+    }
+    return false;
+  }
+
+  void checkParallelDeflate()
+  {
+    cppzip::ZipArchive z;
+    cppzip::CompressionOptions options;
+    options.threads = 4;
+    options.block_size = 64 << 10;
+    z.setCompressionOptions(options);
+    const auto text = content(6, (1 << 20) + 12345);
+    z.addData("blocks.txt", text.data(), text.size());
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    const auto entry = r.getEntry("blocks.txt");
+    check(entry->getCompressedSize() < text.size() / 4, "parallel blocks compress");
+    check(read(entry) == text, "parallel blocks join into one deflate stream");
+
+    static const char byte = 0;
+    check(throws([&] { z.addData("huge.bin", &byte, uint64_t(5) << 30); }), "entries of 4 GiB are rejected");
+    check(!z.hasEntry("huge.bin"), "a rejected entry is not added");
+  }
+
+  /**
+   * A directory below the temporary directory which is removed with the object.
+   */
+  class TempDirectory final
+  {
+  public:
+    TempDirectory() : m_path{boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()}
+    {
+      boost::filesystem::create_directories(m_path);
+    }
+
+    ~TempDirectory()
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(m_path, ec);
+    }
+
+    TempDirectory(const TempDirectory&) = delete;
+    TempDirectory& operator=(const TempDirectory&) = delete;
+
+    auto path() const -> const boost::filesystem::path&
+    {
+      return m_path;
+    }
+
+  private:
+    boost::filesystem::path m_path;
+  };
+
+  void writeFile(const boost::filesystem::path& path, const std::string& text)
+  {
+    boost::filesystem::create_directories(path.parent_path());
+    std::ofstream out(path.string(), std::ios::binary);
+    out << text;
+  }
+
+  auto readFile(const boost::filesystem::path& path) -> std::string
+  {
+    std::ifstream in(path.string(), std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+  }
+
+  void checkAddDirectory()
+  {
+    TempDirectory tmp;
+    const auto root = tmp.path() / "tree";
+    writeFile(root / "b.txt", content(7, 300000));
+    writeFile(root / "a" / "z.txt", content(8, 1000));
+    writeFile(root / "a" / "y.log", "skipped");
+    writeFile(root / "skip" / "x.txt", "skipped");
+    boost::filesystem::create_directories(root / "c");
+
+    cppzip::ZipArchive z;
+    cppzip::AddDirectoryOptions options;
+    options.threads = 3;
+    options.max_in_flight_bytes = 1;
+    const auto added = z.addDirectory(root, "pkg", [](const boost::filesystem::path& p) {
+      return p.extension() != ".log" && p.filename() != "skip";
+    }, options);
+    check(added == 5, "addDirectory returns the number of entries added");
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    check(names(r.getEntries()) == std::vector<std::string>{"pkg/", "pkg/a/", "pkg/a/z.txt", "pkg/b.txt", "pkg/c/"},
+          "addDirectory appends the filtered tree in sorted order");
+    check(read(r.getEntry("pkg/b.txt")) == content(7, 300000), "addDirectory stores the file content");
+  }
+
+  /**
+   * A deflated entry with a zip64 data descriptor, written by Info-ZIP zip 3.0 to a pipe.
+   */
+  const uint8_t piped_zip[] = {
+      0x50, 0x4b, 0x03, 0x04, 0x2d, 0x00, 0x08, 0x00, 0x08, 0x00, 0xb3, 0x09, 0x53, 0x5d, 0x00, 0x00, 0x00, 0x00,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0x00, 0x14, 0x00, 0x2d, 0x01, 0x00, 0x10, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xcb, 0x48, 0xcd,
+      0xc9, 0xc9, 0x57, 0x28, 0x2e, 0x29, 0x4a, 0x4d, 0xcc, 0x55, 0xc8, 0x18, 0x99, 0x1c, 0x00, 0x50, 0x4b, 0x07,
+      0x08, 0x72, 0xe8, 0xa1, 0xc2, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x01, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x50, 0x4b, 0x01, 0x02, 0x1e, 0x03, 0x2d, 0x00, 0x08, 0x00, 0x08, 0x00, 0xb3, 0x09, 0x53,
+      0x5d, 0x72, 0xe8, 0xa1, 0xc2, 0x12, 0x00, 0x00, 0x00, 0x04, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x80, 0x11, 0x00, 0x00, 0x00, 0x00, 0x2d, 0x50, 0x4b, 0x05, 0x06,
+      0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x2f, 0x00, 0x00, 0x00, 0x5d, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+  using StreamedEntries = std::vector<std::pair<std::string, std::string>>;
+
+  /**
+   * Reads all the entries with reads of at most chunk bytes.
+   */
+  auto readStream(std::istream& in, size_t chunk, bool* central_directory = nullptr) -> StreamedEntries
+  {
+    StreamedEntries result;
+    cppzip::ZipStreamReader reader(in);
+    std::vector<char> buffer(chunk);
+    while (reader.next())
+    {
+      std::string text;
+      while (const auto n = reader.read(buffer.data(), buffer.size()))
+      {
+        text.append(buffer.data(), n);
+      }
+      result.emplace_back(reader.getEntryName(), std::move(text));
+    }
+    if (central_directory)
+    {
+      *central_directory = reader.hasCentralDirectory();
+    }
+    return result;
+  }
+
+  auto readStream(const std::vector<uint8_t>& data, size_t chunk, bool* central_directory = nullptr)
+      -> StreamedEntries
+  {
+    std::istringstream in(std::string(data.begin(), data.end()));
+    return readStream(in, chunk, central_directory);
+  }
+
+  void checkStreamReader()
+  {
+    cppzip::ZipArchive z;
+    const std::string zeros(1 << 20, '\0');
+    z.addData("zeros.bin", zeros.data(), zeros.size());
+    // Inflate holds the end of the last match after taking the last byte of this payload.
+    const std::string tail(377, '\0');
+    z.addData("tail.bin", tail.data(), tail.size());
+    const auto text = content(9, 50000);
+    z.addData("text.txt", std::vector<uint8_t>(text.begin(), text.end()), cppzip::CompressionMethod::no);
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    const StreamedEntries expected{{"zeros.bin", zeros}, {"tail.bin", tail}, {"text.txt", text}};
+    for (const size_t chunk : {1, 7, 65536})
+    {
+      bool central_directory = false;
+      check(readStream(data, chunk, &central_directory) == expected && central_directory,
+            "stream reader with reads of " + std::to_string(chunk) + " bytes");
+    }
+
+    bool central_directory = false;
+    const auto piped = readStream(std::vector<uint8_t>(std::begin(piped_zip), std::end(piped_zip)), 3,
+                                  &central_directory);
+    std::string hello;
+    for (int i = 0; i < 20; ++i)
+    {
+      hello += "hello stream ";
+    }
+    check(piped == StreamedEntries{{"-", hello}} && central_directory, "stream reader with a data descriptor");
+
+    cppzip::ZipArchive twice;
+    twice.addData("one.txt", "first", 5);
+    twice.addData("two.txt", "second", 6);
+    std::vector<uint8_t> duplicate;
+    twice.writeArchive(duplicate);
+    // Renames the second record in its local header and in the central directory.
+    const std::string second = "two.txt";
+    for (auto iter = duplicate.begin();
+         (iter = std::search(iter, duplicate.end(), second.begin(), second.end())) != duplicate.end();)
+    {
+      iter = std::copy_n("one.txt", second.size(), iter);
+    }
+    central_directory = false;
+    const StreamedEntries same_name{{"one.txt", "first"}, {"one.txt", "second"}};
+    check(readStream(duplicate, 4096, &central_directory) == same_name && central_directory,
+          "stream reader accepts records of the same name");
+
+    auto mismatch = data;
+    const std::string central = "PK\x01\x02";
+    const auto header = std::search(mismatch.begin(), mismatch.end(), central.begin(), central.end());
+    header[16] ^= 1;
+    check(throws([&] { readStream(mismatch, 4096); }), "stream reader rejects a central directory which differs");
+
+#ifndef _WIN32
+    int fds[2];
+    if (pipe(fds) == 0)
+    {
+      std::thread writer([&data, fd = fds[1]] {
+        for (size_t pos = 0; pos < data.size();)
+        {
+          // Small writes so the reader sees partial input.
+          const auto n = write(fd, data.data() + pos, std::min<size_t>(1000, data.size() - pos));
+          if (n <= 0)
+          {
+            break;
+          }
+          pos += static_cast<size_t>(n);
+        }
+        close(fd);
+      });
+      boost::iostreams::stream<boost::iostreams::file_descriptor_source> in(
+          fds[0], boost::iostreams::close_handle);
+      central_directory = false;
+      check(readStream(in, 4096, &central_directory) == expected && central_directory, "stream reader on a pipe");
+      writer.join();
+    }
+#endif
+  }
+
+  void checkExtract()
+  {
+    TempDirectory tmp;
+    cppzip::ZipArchive z;
+    const auto deflated = content(10, 200000);
+    const auto stored = content(11, 70000);
+    z.addData("d/deflated.txt", deflated.data(), deflated.size());
+    z.addData("d/stored.txt", std::vector<uint8_t>(stored.begin(), stored.end()), cppzip::CompressionMethod::no);
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    const auto path = tmp.path() / "archive.zip";
+    writeFile(path, std::string(data.begin(), data.end()));
+
+    {
+      cppzip::ZipArchive r(path, cppzip::ZipArchive::OpenMode::ReadOnly);
+      check(r.getEntry("d/stored.txt")->extractTo(tmp.path() / "stored.txt") == stored.size() &&
+                readFile(tmp.path() / "stored.txt") == stored,
+            "extractTo copies a stored entry");
+      check(r.getEntry("d/deflated.txt")->extractTo(tmp.path() / "deflated.txt") == deflated.size() &&
+                readFile(tmp.path() / "deflated.txt") == deflated,
+            "extractTo inflates a deflated entry");
+      r.extractAll(tmp.path() / "all");
+      check(readFile(tmp.path() / "all" / "d" / "stored.txt") == stored &&
+                readFile(tmp.path() / "all" / "d" / "deflated.txt") == deflated,
+            "extractAll writes every entry");
+    }
+
+    // One byte of each payload flipped, the local headers are 30 bytes plus the name.
+    const auto snapshot = z.getSnapshot();
+    for (size_t i = 0; i < snapshot.size(); ++i)
+    {
+      if (snapshot.compressed_sizes[i])
+      {
+        data[snapshot.offsets[i] + 30 + snapshot.names[i].size() + snapshot.compressed_sizes[i] / 2] ^= 0x55;
+      }
+    }
+    const auto corrupt = tmp.path() / "corrupt.zip";
+    writeFile(corrupt, std::string(data.begin(), data.end()));
+    cppzip::ZipArchive r(corrupt, cppzip::ZipArchive::OpenMode::ReadOnly);
+    for (const auto name : {"d/stored.txt", "d/deflated.txt"})
+    {
+      const auto target = tmp.path() / "bad.txt";
+      check(throws([&] { r.getEntry(name)->extractTo(target, true); }) && !boost::filesystem::exists(target),
+            std::string("extractTo removes the file when the CRC of ") + name + " fails");
+    }
+    check(throws([&] { r.extractAll(tmp.path() / "bad"); }) &&
+              !boost::filesystem::exists(tmp.path() / "bad" / "d" / "stored.txt"),
+          "extractAll does not write a stored entry whose CRC fails");
+  }
+
+  void checkStaging()
+  {
+    cppzip::ZipArchive z;
+    cppzip::StagingOptions options;
+    options.memory_budget = 64 << 10;
+    options.min_staged_size = 1 << 10;
+    z.setStagingOptions(options);
+    const auto big = content(3, 1 << 20);
+    z.addData("big.txt", big.data(), big.size());
+    z.addData("small.txt", "small", 5);
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    check(read(r.getEntry("big.txt")) == big, "staged entry round trips");
+    check(read(r.getEntry("small.txt")) == "small", "entry kept in memory next to a staged one");
+  }
+
+  void checkOwningAdd()
+  {
+    cppzip::ZipArchive z;
+    const auto text = content(2, 5000);
+    z.addData("a/stored.txt", std::vector<uint8_t>(text.begin(), text.end()), cppzip::CompressionMethod::no);
+    z.addData("a/deflated.txt", std::vector<uint8_t>(text.begin(), text.end()));
+    z.addData("a/empty.txt", std::vector<uint8_t>{});
+    cppzip::ZipArchive moved(std::move(z));
+    cppzip::ZipArchive assigned;
+    assigned = std::move(moved);
+    std::vector<uint8_t> data;
+    assigned.writeArchive(data);
+
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    check(r.getEntries().size() == 4, "a moved archive keeps its entries");
+    check(read(r.getEntry("a/stored.txt")) == text && read(r.getEntry("a/deflated.txt")) == text,
+          "owned data round trips");
+    check(r.getEntry("a/deflated.txt")->getCompressionMethod() == cppzip::CompressionMethod::defalted,
+          "owned data is deflated by default");
+    const auto empty = r.getEntry("a/empty.txt");
+    check(read(empty).empty() && empty->getCompressionMethod() == cppzip::CompressionMethod::no,
+          "an empty payload is stored, not deflated");
+  }
+
+  /**
+   * The uncached conversion of a DOS date and time, as datetime_to_timestamp did it.
+   */
+  auto referenceTimestamp(uint32_t dos_time) -> time_t
+  {
+    tm t{};
+    t.tm_year = ((dos_time >> 25) & 0x7f) + 80;
+    t.tm_mon = ((dos_time >> 21) & 0x0f) - 1;
+    t.tm_mday = (dos_time >> 16) & 0x1f;
+    t.tm_hour = (dos_time >> 11) & 0x1f;
+    t.tm_min = (dos_time >> 5) & 0x3f;
+    t.tm_sec = (dos_time << 1) & 0x3f;
+    t.tm_isdst = -1;
+    return mktime(&t);
+  }
+
+  void checkDosTimes(const std::string& zone)
+  {
+    bool same = true;
+    bool round_trip = true;
+    // Twice, the second pass is answered from the cache. Hours 1 to 3 hold the daylight saving
+    // changes, where the local time is missing or ambiguous.
+    for (int pass = 0; pass < 2; ++pass)
+    {
+      for (const uint32_t year : {0, 20, 45})
+      {
+        for (uint32_t month = 1; month <= 12; month += 3)
+        {
+          for (const uint32_t hour : {6, 18})
+          {
+            for (uint32_t minute = 0; minute < 60; minute += 13)
+            {
+              const uint32_t date = year << 9 | month << 5 | (month * 2 + 1);
+              const uint32_t dos_time = date << 16 | hour << 11 | minute << 5 | (minute + hour) % 30;
+              const auto timestamp = cppzip::dosTimeToTimestamp(dos_time);
+              same = same && timestamp == referenceTimestamp(dos_time);
+              round_trip = round_trip && cppzip::timestampToDosTime(timestamp) == dos_time;
+            }
+          }
+        }
+      }
+    }
+    check(same, zone + ": cached DOS times match the uncached conversion");
+    check(round_trip, zone + ": timestampToDosTime reverses dosTimeToTimestamp");
+  }
+
+  void checkSnapshot()
+  {
+    cppzip::ZipArchive z;
+    const auto text = content(12, 30000);
+    z.addData("s/deflated.txt", text.data(), text.size());
+    z.addData("s/stored.txt", std::vector<uint8_t>(text.begin(), text.end()), cppzip::CompressionMethod::no);
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    const auto snapshot = r.getSnapshot();
+    const auto entries = r.getEntries();
+    bool same = snapshot.size() == entries.size() && snapshot.size() == 3;
+    for (size_t i = 0; same && i < snapshot.size(); ++i)
+    {
+      const auto& e = entries[i];
+      same = snapshot.names[i] == e->getEntryName() && snapshot.methods[i] == e->getCompressionMethod() &&
+             snapshot.crc32s[i] == e->getCRC() && snapshot.compressed_sizes[i] == e->getCompressedSize() &&
+             snapshot.uncompressed_sizes[i] == e->getUncompressedSize() && snapshot.timestamps[i] == e->getDate() &&
+             (i == 0 ? snapshot.offsets[i] == 0 : snapshot.offsets[i] > snapshot.offsets[i - 1]);
+    }
+    check(same, "snapshot columns match the entries");
+    check(snapshot.uncompressed_sizes[2] == text.size() && snapshot.compressed_sizes[1] < text.size() / 2,
+          "snapshot sizes");
+
+    checkDosTimes("local time");
+#ifndef _WIN32
+    // A zone with daylight saving and one offset by half an hour.
+    for (const auto zone : {"CET-1CEST,M3.5.0,M10.5.0/3", "IST-5:30"})
+    {
+      setenv("TZ", zone, 1);
+      tzset();
+      cppzip::resetDosTimeCache();
+      checkDosTimes(zone);
+    }
+    unsetenv("TZ");
+    tzset();
+    cppzip::resetDosTimeCache();
+#endif
+  }
+
+  auto allOk(const std::vector<cppzip::EntryReport>& reports) -> bool
+  {
+    return std::all_of(reports.begin(), reports.end(), [](const cppzip::EntryReport& r) { return r.ok(); });
+  }
+
+  uint32_t getLittle(const std::vector<uint8_t>& data, size_t offset, size_t size)
+  {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+      value |= static_cast<uint32_t>(data[offset + i]) << (8 * i);
+    }
+    return value;
+  }
+
+  void putLittle(std::vector<uint8_t>& data, size_t offset, uint32_t value)
+  {
+    for (size_t i = 0; i < 4; ++i)
+    {
+      data[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+  }
+
+  /**
+   * Puts a stub in front of an archive without comment, like a self extracting one, and moves
+   * the offsets of the central directory along.
+   */
+  auto prependStub(std::vector<uint8_t> data, const std::string& stub) -> std::vector<uint8_t>
+  {
+    const size_t end = data.size() - 22;
+    const auto directory = getLittle(data, end + 16, 4);
+    for (size_t pos = directory; pos < end;)
+    {
+      putLittle(data, pos + 42, getLittle(data, pos + 42, 4) + static_cast<uint32_t>(stub.size()));
+      pos += 46 + getLittle(data, pos + 28, 2) + getLittle(data, pos + 30, 2) + getLittle(data, pos + 32, 2);
+    }
+    putLittle(data, end + 16, directory + static_cast<uint32_t>(stub.size()));
+    data.insert(data.begin(), stub.begin(), stub.end());
+    return data;
+  }
+
+  /**
+   * Re-opens the archive and checks that it holds exactly the expected files and verifies.
+   */
+  void checkContent(const boost::filesystem::path& path,
+                    const std::map<std::string, std::string>& expected,
+                    const std::string& step)
+  {
+    cppzip::ZipArchive r(path, cppzip::ZipArchive::OpenMode::ReadOnly);
+    std::map<std::string, std::string> found;
+    for (const auto& entry : r.getEntries())
+    {
+      found[entry->getEntryName()] = read(entry);
+    }
+    check(found == expected, step + ": the re-opened archive holds the expected entries");
+    check(allOk(r.verify(2)), step + ": verify accepts the archive");
+  }
+
+  void checkRewrite()
+  {
+    TempDirectory tmp;
+    std::map<std::string, std::string> expected;
+    cppzip::ZipArchive z;
+    for (int i = 0; i < 5; ++i)
+    {
+      const auto name = "entry" + std::to_string(i) + ".txt";
+      expected[name] = content(20 + i, 20000 + 1000 * i);
+      const auto& text = expected[name];
+      if (i % 2)
+      {
+        z.addData(name, std::vector<uint8_t>(text.begin(), text.end()), cppzip::CompressionMethod::no);
+      }
+      else
+      {
+        z.addData(name, text.data(), text.size());
+      }
+    }
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+
+    const auto path = tmp.path() / "rewrite.zip";
+    writeFile(path, std::string(data.begin(), data.end()));
+    {
+      cppzip::ZipArchive w(path, cppzip::ZipArchive::OpenMode::Write);
+      check(w.renameEntry("entry1.txt", "ENTRY1.txt"), "renameEntry to a name of the same length");
+      expected["ENTRY1.txt"] = expected["entry1.txt"];
+      expected.erase("entry1.txt");
+    }
+    checkContent(path, expected, "same length rename");
+    {
+      cppzip::ZipArchive w(path, cppzip::ZipArchive::OpenMode::Write);
+      check(w.renameEntry("entry2.txt", "a-much-longer-name-for-entry2.txt"), "renameEntry to a longer name");
+      check(!w.renameEntry("entry3.txt", "entry4.txt"), "renameEntry refuses a taken name");
+      expected["a-much-longer-name-for-entry2.txt"] = expected["entry2.txt"];
+      expected.erase("entry2.txt");
+    }
+    checkContent(path, expected, "longer rename");
+    const auto before = boost::filesystem::file_size(path);
+    // The first, a middle and the last record. The longer rename copied entry2 to the end.
+    for (const auto name : {"entry0.txt", "entry3.txt", "a-much-longer-name-for-entry2.txt"})
+    {
+      {
+        cppzip::ZipArchive w(path, cppzip::ZipArchive::OpenMode::Write);
+        check(w.removeEntry(name), std::string("removeEntry ") + name);
+      }
+      expected.erase(name);
+      checkContent(path, expected, std::string("remove ") + name);
+    }
+    {
+      cppzip::ZipArchive w(path, cppzip::ZipArchive::OpenMode::Write);
+      w.compact();
+    }
+    checkContent(path, expected, "compact");
+    // entry3 alone was stored with 23000 bytes.
+    check(boost::filesystem::file_size(path) + 23000 < before, "compact reclaims the removed records");
+
+    const std::string stub(1000, 'S');
+    const auto stubbed = tmp.path() / "stub.zip";
+    const auto with_stub = prependStub(data, stub);
+    writeFile(stubbed, std::string(with_stub.begin(), with_stub.end()));
+    std::map<std::string, std::string> all;
+    for (int i = 0; i < 5; ++i)
+    {
+      all["entry" + std::to_string(i) + ".txt"] = content(20 + i, 20000 + 1000 * i);
+    }
+    checkContent(stubbed, all, "stub");
+    {
+      cppzip::ZipArchive w(stubbed, cppzip::ZipArchive::OpenMode::Write);
+      w.removeEntry("entry0.txt");
+      w.removeEntry("entry2.txt");
+      w.compact();
+    }
+    all.erase("entry0.txt");
+    all.erase("entry2.txt");
+    checkContent(stubbed, all, "compact behind a stub");
+    check(readFile(stubbed).compare(0, stub.size(), stub) == 0, "compact keeps the stub");
+  }
+
+  void writeArchive(const boost::filesystem::path& path, const std::map<std::string, std::string>& files)
+  {
+    cppzip::ZipArchive z;
+    for (const auto& file : files)
+    {
+      z.addData(file.first, file.second.data(), file.second.size());
+    }
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    writeFile(path, std::string(data.begin(), data.end()));
+  }
+
+  /**
+   * Returns the number of open file descriptors, or 0 where that is not known.
+   */
+  auto openFiles() -> size_t
+  {
+#ifdef __linux__
+    boost::system::error_code ec;
+    const boost::filesystem::directory_iterator iter("/proc/self/fd", ec);
+    return ec ? 0 : static_cast<size_t>(std::distance(iter, boost::filesystem::directory_iterator{}));
+#else
+    return 0;
+#endif
+  }
+
+  void checkOverlay()
+  {
+    TempDirectory tmp;
+    const auto bottom = tmp.path() / "bottom.zip";
+    const auto middle = tmp.path() / "middle.zip";
+    const auto top = tmp.path() / "top.zip";
+    writeArchive(bottom, {{"common.txt", "bottom"}, {"bottom.txt", "b"}, {"dir/x.txt", "bottom"}});
+    writeArchive(middle, {{"common.txt", "middle"}, {"middle.txt", "m"}});
+    writeArchive(top, {{"common.txt", "top"}, {"dir/x.txt", "top"}});
+
+    cppzip::ZipOverlay overlay;
+    check(overlay.mount(bottom) && overlay.mount(middle) && overlay.mount(top), "mount");
+    check(!overlay.mount(middle), "mount refuses an archive which is mounted");
+    check(read(overlay.getEntry("common.txt")) == "top" && overlay.getArchivePath("common.txt") == top,
+          "the last mounted archive wins");
+    check(read(overlay.getEntry("dir/x.txt")) == "top" && read(overlay.getEntry("bottom.txt")) == "b",
+          "names of lower archives stay visible");
+    check(overlay.getNumberOfEntries() == 5, "the merged index counts each name once");
+    check(overlay.listDirectory("") ==
+              std::vector<std::string>{"bottom.txt", "common.txt", "dir/", "middle.txt"},
+          "listDirectory of the merged tree");
+
+    check(overlay.unmount(top), "unmount");
+    check(read(overlay.getEntry("common.txt")) == "middle" && read(overlay.getEntry("dir/x.txt")) == "bottom",
+          "unmount hands each name to the next archive below");
+    check(overlay.unmount(middle) && !overlay.hasEntry("middle.txt") &&
+              read(overlay.getEntry("common.txt")) == "bottom",
+          "unmount drops the names no other archive has");
+    check(!overlay.unmount(middle), "unmount refuses an archive which is not mounted");
+
+    // One open archive at a time: every switch closes the least recently used one and a lookup
+    // opens it again.
+    cppzip::OverlayOptions options;
+    options.max_open_archives = 1;
+    cppzip::ZipOverlay pooled(options);
+    const auto files = openFiles();
+    std::vector<boost::filesystem::path> paths;
+    for (int i = 0; i < 4; ++i)
+    {
+      paths.push_back(tmp.path() / ("pool" + std::to_string(i) + ".zip"));
+      writeArchive(paths.back(), {{"file" + std::to_string(i), content(i, 100)}});
+      pooled.mount(paths.back());
+    }
+    bool same = true;
+    for (int round = 0; round < 3; ++round)
+    {
+      for (int i = 0; i < 4; ++i)
+      {
+        same = same && read(pooled.getEntry("file" + std::to_string(i))) == content(i, 100);
+      }
+    }
+    check(same, "archives closed by the pool are opened again");
+    check(openFiles() <= files + 1, "the pool keeps one archive open");
+    const auto held = pooled.getEntry("file0");
+    for (int i = 1; i < 4; ++i)
+    {
+      pooled.getEntry("file" + std::to_string(i));
+    }
+    check(read(held) == content(0, 100), "an entry keeps its archive open after the pool closed it");
+  }
+
+  void checkReadEntries()
+  {
+    TempDirectory tmp;
+    std::map<std::string, std::string> files;
+    for (int i = 0; i < 30; ++i)
+    {
+      // Sizes between 1 KB and 40 KB, so spans hold several records and some records end one.
+      files["r/" + std::to_string(i)] = content(30 + i, 1000 + static_cast<size_t>(i * 7919 % 40000));
+    }
+    const auto path = tmp.path() / "read.zip";
+    writeArchive(path, files);
+    cppzip::ZipArchive r(path, cppzip::ZipArchive::OpenMode::ReadOnly);
+
+    std::vector<std::string> wanted;
+    for (int i = 29; i >= 0; i -= 2)
+    {
+      wanted.push_back("r/" + std::to_string(i));
+    }
+    using Backend = cppzip::BulkReadOptions::Backend;
+    for (const auto backend : {Backend::ThreadPool, Backend::Automatic})
+    {
+      cppzip::BulkReadOptions options;
+      options.backend = backend;
+      options.threads = 3;
+      options.coalesce_gap = 64 << 10;
+      options.max_coalesced_read = 48 << 10;
+      std::mutex mutex;
+      std::map<std::string, std::string> found;
+      bool duplicate = false;
+      r.readEntries(
+          wanted,
+          [&](const cppzip::ZipEntryPtr& entry, const std::vector<uint8_t>& data) {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto inserted = found.emplace(entry->getEntryName(), std::string(data.begin(), data.end()));
+            duplicate = duplicate || !inserted.second;
+          },
+          options);
+      bool same = found.size() == wanted.size() && !duplicate;
+      for (const auto& name : wanted)
+      {
+        same = same && found[name] == files[name];
+      }
+      check(same, "readEntries hands every name its content once, backend " +
+                      std::to_string(static_cast<int>(backend)));
+    }
+    const cppzip::EntryContent_fn ignore = [](const cppzip::ZipEntryPtr&, const std::vector<uint8_t>&) {};
+    check(throws([&] { r.readEntries({"r/0", "missing"}, ignore); }), "readEntries throws for a missing name");
+  }
+
+  void checkWriteToMemory()
+  {
+    cppzip::ZipArchive z;
+    const auto text = content(1, 100000);
+    z.addData("m/deflated.txt", text.data(), text.size());
+    z.addData("m/stored.txt", std::vector<uint8_t>(text.begin(), text.end()), cppzip::CompressionMethod::no);
+    z.setComment("written to memory");
+    const auto size = z.computeArchiveSize();
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    check(data.size() == size, "computeArchiveSize matches the written archive");
+    std::ostringstream stream;
+    z.writeArchive(stream);
+    check(stream.str() == std::string(data.begin(), data.end()), "writing to memory and to a stream agree");
+
+    std::vector<uint8_t> buffer(size + 10);
+    check(z.writeArchive(buffer.data(), buffer.size()) == size &&
+              std::equal(data.begin(), data.end(), buffer.begin()),
+          "writeArchive into a caller buffer");
+    check(throws([&] { z.writeArchive(buffer.data(), static_cast<size_t>(size - 1)); }),
+          "writeArchive refuses a buffer which is too small");
+
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    check(read(r.getEntry("m/deflated.txt")) == text && read(r.getEntry("m/stored.txt")) == text &&
+              r.getComment() == "written to memory",
+          "an archive written to memory round trips");
+
+    // A loaded record with a data descriptor is written again with its sizes in the header.
+    cppzip::ZipArchive piped(std::vector<uint8_t>(std::begin(piped_zip), std::end(piped_zip)),
+                             cppzip::ZipArchive::OpenMode::ReadOnly);
+    piped.addData("added.txt", "added", 5);
+    const auto piped_size = piped.computeArchiveSize();
+    std::vector<uint8_t> rewritten;
+    piped.writeArchive(rewritten);
+    cppzip::ZipArchive again(rewritten, cppzip::ZipArchive::OpenMode::ReadOnly);
+    check(rewritten.size() == piped_size && read(again.getEntry("-")) == read(piped.getEntry("-")) &&
+              read(again.getEntry("added.txt")) == "added" && allOk(again.verify(1)),
+          "a record with a data descriptor is written to memory");
+  }
+
+  void checkConcurrentAdds()
+  {
+    cppzip::ZipArchive z;
+    z.setConcurrentAdds(true);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+      threads.emplace_back([&z, t] {
+        for (int i = t; i < 40; i += 4)
+        {
+          const auto text = content(i, 3000);
+          z.addData("c/" + std::to_string(i), text.data(), text.size());
+        }
+      });
+    }
+    for (auto& t : threads)
+    {
+      t.join();
+    }
+    const auto size = z.computeArchiveSize();
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    check(size == data.size(), "computeArchiveSize counts queued entries");
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    bool same = r.getEntries().size() == 41;
+    for (int i = 0; same && i < 40; ++i)
+    {
+      same = read(r.getEntry("c/" + std::to_string(i))) == content(i, 3000);
+    }
+    check(same, "entries added from several threads are published");
+  }
+
+  /**
+   * A deflated AE-1 entry with a data descriptor, written by bsdtar 3.7 with the password
+   * "secret" and 256 bit keys.
+   */
+  const uint8_t bsdtar_aes_zip[] = {
+      0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x09, 0x00, 0x63, 0x00, 0xb5, 0x0c, 0x53, 0x5d, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09, 0x00, 0x2b, 0x00, 0x68, 0x65, 0x6c, 0x6c, 0x6f, 0x2e,
+      0x74, 0x78, 0x74, 0x75, 0x78, 0x0b, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+      0x01, 0x99, 0x07, 0x00, 0x01, 0x00, 0x41, 0x45, 0x03, 0x08, 0x00, 0x55, 0x54, 0x0d, 0x00, 0x07, 0x66, 0x74,
+      0xd5, 0x6a, 0x66, 0x74, 0xd5, 0x6a, 0x66, 0x74, 0xd5, 0x6a, 0xbb, 0x0f, 0x1e, 0xa4, 0xa5, 0x7f, 0x6d, 0x11,
+      0xe4, 0x3b, 0x02, 0xe3, 0x20, 0x15, 0x52, 0x1d, 0x60, 0xb2, 0xfc, 0xce, 0xb9, 0x4e, 0x8c, 0xda, 0x80, 0x14,
+      0x27, 0x8d, 0xc1, 0xcf, 0x48, 0x3f, 0x05, 0xe4, 0x33, 0xb2, 0x8a, 0x25, 0xc4, 0xff, 0x2e, 0x50, 0x4b, 0x07,
+      0x08, 0x3d, 0x42, 0x57, 0x1e, 0x29, 0x00, 0x00, 0x00, 0xf0, 0x00, 0x00, 0x00, 0x50, 0x4b, 0x01, 0x02, 0x14,
+      0x03, 0x14, 0x00, 0x09, 0x00, 0x63, 0x00, 0xb5, 0x0c, 0x53, 0x5d, 0x3d, 0x42, 0x57, 0x1e, 0x29, 0x00, 0x00,
+      0x00, 0xf0, 0x00, 0x00, 0x00, 0x09, 0x00, 0x23, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa4,
+      0x81, 0x00, 0x00, 0x00, 0x00, 0x68, 0x65, 0x6c, 0x6c, 0x6f, 0x2e, 0x74, 0x78, 0x74, 0x75, 0x78, 0x0b, 0x00,
+      0x01, 0x04, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x01, 0x99, 0x07, 0x00, 0x01, 0x00, 0x41,
+      0x45, 0x03, 0x08, 0x00, 0x55, 0x54, 0x05, 0x00, 0x01, 0x66, 0x74, 0xd5, 0x6a, 0x50, 0x4b, 0x05, 0x06, 0x00,
+      0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x5a, 0x00, 0x00, 0x00, 0x8b, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+  template<typename F>
+  auto thrownMessage(F&& f) -> std::string
+  {
+    try
+    {
+      f();
+    }
+    catch (const std::exception& e)
+    {
+      return e.what();
+    }
+    return {};
+  }
+
+  /**
+   * Returns the offset of the payload behind the local header at offset.
+   */
+  auto payloadOffset(const std::vector<uint8_t>& data, size_t offset) -> size_t
+  {
+    return offset + 30 + getLittle(data, offset + 26, 2) + getLittle(data, offset + 28, 2);
+  }
+
+  void checkEncryption()
+  {
+    std::string interop;
+    for (int i = 0; i < 30; ++i)
+    {
+      interop += "interop ";
+    }
+    const std::vector<uint8_t> bsdtar(std::begin(bsdtar_aes_zip), std::end(bsdtar_aes_zip));
+    {
+      cppzip::ZipArchive r(bsdtar, cppzip::ZipArchive::OpenMode::ReadOnly);
+      check(r.isEncrypted(), "an AES archive of bsdtar is encrypted");
+      check(thrownMessage([&] { read(r.getEntry("hello.txt")); }) == "Entry is encrypted, a password is required",
+            "reading an AES entry needs a password");
+      r.setPassword("wrong");
+      check(thrownMessage([&] { read(r.getEntry("hello.txt")); }) == "Wrong password", "a wrong password is refused");
+      r.setPassword("secret");
+      check(read(r.getEntry("hello.txt")) == interop && allOk(r.verify(1)), "an AES archive of bsdtar decrypts");
+    }
+    // The CRC of an AE-1 entry is in its data descriptor and in the central directory.
+    auto bad_crc = bsdtar;
+    for (const auto signature : {"PK\x07\x08", "PK\x01\x02"})
+    {
+      auto at = std::search(bad_crc.begin(), bad_crc.end(), signature, signature + 4);
+      at[signature[3] == 8 ? 4 : 16] ^= 1;
+    }
+    {
+      cppzip::ZipArchive r(bad_crc, cppzip::ZipArchive::OpenMode::ReadOnly);
+      r.setPassword("secret");
+      check(throws([&] { read(r.getEntry("hello.txt")); }) && !allOk(r.verify(1)),
+            "the CRC of an AE-1 entry is checked");
+    }
+
+    TempDirectory tmp;
+    using Strength = cppzip::EncryptionOptions::Strength;
+    for (const auto strength : {Strength::aes128, Strength::aes192, Strength::aes256})
+    {
+      const auto label = "AES strength " + std::to_string(static_cast<int>(strength)) + ": ";
+      cppzip::ZipArchive z;
+      cppzip::EncryptionOptions options;
+      options.password = "p\xc3\xa4ssword";
+      options.strength = strength;
+      z.setEncryptionOptions(options);
+      const auto text = content(40, 300000);
+      z.addData("deflated.txt", text.data(), text.size());
+      z.addData("stored.txt", std::vector<uint8_t>(text.begin(), text.end()), cppzip::CompressionMethod::no);
+      std::vector<uint8_t> data;
+      z.writeArchive(data);
+      const auto path = tmp.path() / "aes.zip";
+      writeFile(path, std::string(data.begin(), data.end()));
+
+      cppzip::ZipArchive r(path, cppzip::ZipArchive::OpenMode::ReadOnly);
+      r.setPassword(options.password);
+      bool same = true;
+      for (const auto name : {"deflated.txt", "stored.txt"})
+      {
+        const auto entry = r.getEntry(name);
+        const auto target = tmp.path() / name;
+        same = same && entry->isEncrypted() && read(entry) == text && entry->extractTo(target) == text.size() &&
+               readFile(target) == text;
+      }
+      check(same, label + "extractTo and readContent agree with the content");
+      const auto range = r.getEntry("deflated.txt")->readRange(123456, 1000);
+      check(std::string(range.begin(), range.end()) == text.substr(123456, 1000), label + "readRange decrypts");
+
+      // One byte in the middle of each encrypted payload flipped.
+      const auto snapshot = z.getSnapshot();
+      for (size_t i = 0; i < snapshot.size(); ++i)
+      {
+        data[payloadOffset(data, snapshot.offsets[i]) + snapshot.compressed_sizes[i] / 2] ^= 0x10;
+      }
+      const auto corrupt = tmp.path() / "corrupt.zip";
+      writeFile(corrupt, std::string(data.begin(), data.end()));
+      cppzip::ZipArchive c(corrupt, cppzip::ZipArchive::OpenMode::ReadOnly);
+      c.setPassword(options.password);
+      bool refused = true;
+      for (const auto name : {"deflated.txt", "stored.txt"})
+      {
+        const auto target = tmp.path() / "bad.txt";
+        refused = refused && throws([&] { read(c.getEntry(name)); }) &&
+                  throws([&] { c.getEntry(name)->extractTo(target); }) && !boost::filesystem::exists(target);
+      }
+      check(refused, label + "a flipped byte fails the authentication code");
+    }
+  }
+
+  void checkRemoteSource()
+  {
+    cppzip::ZipArchive z;
+    for (int i = 0; i < 500; ++i)
+    {
+      const auto text = content(i, 1000);
+      const auto name = "e/" + std::to_string(i);
+      z.addData(name, std::vector<uint8_t>(text.begin(), text.end()), cppzip::CompressionMethod::no);
+    }
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+
+    // 530 KB of records and 27 KB of central directory, read in 64 KiB blocks. The tail holds
+    // the whole directory, the local headers are read in growing readahead windows. A cache of
+    // two blocks reads each block once per pass.
+    struct Expected
+    {
+      size_t cached_blocks;
+      unsigned open_calls;
+      unsigned scan_calls;
+    };
+    for (const auto& expected : {Expected{256, 6, 0}, Expected{2, 10, 9}})
+    {
+      const auto source = std::make_shared<SlowSource>(data, std::chrono::milliseconds(2));
+      cppzip::SourceCacheOptions options;
+      options.max_cached_blocks = expected.cached_blocks;
+      cppzip::ZipArchive r(source, options);
+      const auto open_calls = source->calls();
+      const auto label = std::to_string(expected.cached_blocks) + " cached blocks: ";
+      check(open_calls <= expected.open_calls,
+            label + "directory parse takes " + std::to_string(open_calls) + " source reads");
+
+      bool same = true;
+      for (int i = 0; i < 500; ++i)
+      {
+        same = same && read(r.getEntry("e/" + std::to_string(i))) == content(i, 1000);
+      }
+      check(same, label + "sequential scan reads every entry");
+      const auto scan_calls = source->calls() - open_calls;
+      check(scan_calls <= expected.scan_calls,
+            label + "sequential scan takes " + std::to_string(scan_calls) + " source reads");
+    }
+  }
+
+  void checkPrecompressed()
+  {
+    const auto text = content(4, 20000);
+    z_stream strm{};
+    deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::vector<uint8_t> payload(deflateBound(&strm, static_cast<uLong>(text.size())));
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    strm.avail_in = static_cast<uInt>(text.size());
+    strm.next_out = payload.data();
+    strm.avail_out = static_cast<uInt>(payload.size());
+    deflate(&strm, Z_FINISH);
+    payload.resize(strm.total_out);
+    deflateEnd(&strm);
+    const auto crc = static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(text.data()),
+                                                 static_cast<uInt>(text.size())));
+
+    cppzip::ZipArchive z;
+    z.addPrecompressed("pre.txt", std::vector<uint8_t>(payload), crc, text.size());
+    z.addPrecompressed("borrowed.txt", payload.data(), payload.size(), crc, text.size());
+    check(throws([&] {
+            z.addPrecompressed("raw.txt", std::vector<uint8_t>(payload), crc, text.size(),
+                               cppzip::CompressionMethod::no);
+          }),
+          "addPrecompressed rejects stored sizes which differ");
+    // The sizes of a deflated payload are trusted until verify.
+    z.addPrecompressed("bad.txt", std::vector<uint8_t>(payload), crc, text.size() + 1);
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    check(read(r.getEntry("pre.txt")) == text && read(r.getEntry("borrowed.txt")) == text,
+          "precompressed entries round trip");
+    check(r.getEntry("pre.txt")->getCompressedSize() == payload.size(), "the payload is written as given");
+    const auto reports = r.verify(1);
+    check(std::count_if(reports.begin(), reports.end(), [](const cppzip::EntryReport& e) { return !e.ok(); }) == 1,
+          "verify reports the precompressed entry with a wrong size");
+  }
+
+  /**
+   * Returns the finished files of a compression cache directory.
+   */
+  auto cachedFiles(const boost::filesystem::path& directory) -> std::vector<boost::filesystem::path>
+  {
+    std::vector<boost::filesystem::path> files;
+    for (boost::filesystem::recursive_directory_iterator iter(directory), end; iter != end; ++iter)
+    {
+      if (boost::filesystem::is_regular_file(iter->status()) && iter->path().extension() != ".tmp")
+      {
+        files.push_back(iter->path());
+      }
+    }
+    return files;
+  }
+
+  /**
+   * Builds an archive of the files through the cache and returns the compressed size of each entry.
+   */
+  auto cachedBuild(const boost::filesystem::path& directory,
+                   uint64_t max_size,
+                   const std::map<std::string, std::string>& files) -> std::map<std::string, uint64_t>
+  {
+    cppzip::ZipArchive z;
+    cppzip::CompressionCacheOptions options;
+    options.directory = directory;
+    options.max_size = max_size;
+    z.setCompressionCache(options);
+    for (const auto& file : files)
+    {
+      z.addData(file.first, file.second.data(), file.second.size());
+    }
+    std::vector<uint8_t> data;
+    z.writeArchive(data);
+    cppzip::ZipArchive r(data, cppzip::ZipArchive::OpenMode::ReadOnly);
+    std::map<std::string, uint64_t> sizes;
+    for (const auto& file : files)
+    {
+      const auto entry = r.getEntry(file.first);
+      check(read(entry) == file.second, "cached entry " + file.first + " round trips");
+      sizes[file.first] = entry->getCompressedSize();
+    }
+    return sizes;
+  }
+
+  void checkCompressionCache()
+  {
+    TempDirectory tmp;
+    const auto directory = tmp.path() / "cache";
+    const auto text = content(50, 100000);
+    const auto normal = cachedBuild(directory, 1 << 20, {{"a.txt", text}}).at("a.txt");
+    auto files = cachedFiles(directory);
+    check(files.size() == 1, "a miss stores the payload");
+
+    // Replaces the cached payload with stored deflate blocks of the same content, so the size
+    // of the entry tells whether the build took it from the cache. The file is the magic, the
+    // CRC of the content and of the payload, the length of the content and of the payload.
+    const auto cached = readFile(files.at(0));
+    z_stream strm{};
+    deflateInit2(&strm, 0, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::string payload(deflateBound(&strm, static_cast<uLong>(text.size())), '\0');
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    strm.avail_in = static_cast<uInt>(text.size());
+    strm.next_out = reinterpret_cast<Bytef*>(&payload[0]);
+    strm.avail_out = static_cast<uInt>(payload.size());
+    deflate(&strm, Z_FINISH);
+    payload.resize(strm.total_out);
+    deflateEnd(&strm);
+    auto replaced = cached.substr(0, 28) + payload;
+    patch(replaced, 8, crc32(0, reinterpret_cast<const Bytef*>(payload.data()), static_cast<uInt>(payload.size())),
+          4);
+    patch(replaced, 20, payload.size(), 8);
+    writeFile(files.at(0), replaced);
+    check(cachedBuild(directory, 1 << 20, {{"a.txt", text}}).at("a.txt") == payload.size(),
+          "a hit takes the cached payload instead of deflating");
+
+    auto truncated = replaced.substr(0, replaced.size() - 1);
+    auto flipped = replaced;
+    flipped[100] ^= 1;
+    auto magic = replaced;
+    magic[0] = 'X';
+    auto length = replaced;
+    patch(length, 12, text.size() + 1, 8);
+    for (const auto& broken : {truncated, flipped, magic, length, replaced.substr(0, 10)})
+    {
+      writeFile(files.at(0), broken);
+      check(cachedBuild(directory, 1 << 20, {{"a.txt", text}}).at("a.txt") == normal &&
+                readFile(files.at(0)) == cached,
+            "a damaged cache file is deflated again and replaced");
+    }
+
+    // Identical content within one build, also from several threads, is stored once.
+    const auto dedup = tmp.path() / "dedup";
+    std::map<std::string, std::string> same;
+    for (int i = 0; i < 8; ++i)
+    {
+      same["copy" + std::to_string(i)] = text;
+    }
+    const auto sizes = cachedBuild(dedup, 1 << 20, same);
+    check(cachedFiles(dedup).size() == 1 &&
+              std::all_of(sizes.begin(), sizes.end(), [&](const std::pair<const std::string, uint64_t>& e) {
+                return e.second == normal;
+              }),
+          "identical content in one build is deflated once");
+    const auto threaded = tmp.path() / "threaded";
+    {
+      cppzip::ZipArchive z;
+      cppzip::CompressionCacheOptions options;
+      options.directory = threaded;
+      z.setCompressionCache(options);
+      z.setConcurrentAdds(true);
+      std::vector<std::thread> threads;
+      for (int t = 0; t < 4; ++t)
+      {
+        threads.emplace_back([&z, &text, t] { z.addData("t" + std::to_string(t), text.data(), text.size()); });
+      }
+      for (auto& t : threads)
+      {
+        t.join();
+      }
+      z.publishPendingEntries();
+      check(z.getNumberOfEntries() == 4 && cachedFiles(threaded).size() == 1,
+            "identical content added from several threads is deflated once");
+    }
+
+    // Each payload takes a few KB, the cap holds about four of them.
+    const auto capped = tmp.path() / "capped";
+    const uint64_t cap = 4 * (normal + 28);
+    std::map<std::string, std::string> distinct;
+    for (int i = 0; i < 12; ++i)
+    {
+      distinct["d" + std::to_string(i)] = content(60 + i, 100000);
+    }
+    cachedBuild(capped, cap, distinct);
+    uint64_t total = 0;
+    for (const auto& file : cachedFiles(capped))
+    {
+      total += boost::filesystem::file_size(file);
+    }
+    check(total <= cap && !cachedFiles(capped).empty(), "eviction keeps the cache below its cap");
+  }
+} // namespace
+
 int main(int argc, char* argv[])
 {
   std::cout << "Running: " << argv[0] << " ...\n";
@@ -20,6 +1347,31 @@ int main(int argc, char* argv[])
 
     std::ofstream f("testzip.zip", std::ios::out | std::ios::binary);
     z.writeArchive(f);
+
+    run(checkAsyncRead, "checkAsyncRead");
+    run(checkPathIndex, "checkPathIndex");
+    run(checkInflateIndex, "checkInflateIndex");
+    run(checkParallelDeflate, "checkParallelDeflate");
+    run(checkAddDirectory, "checkAddDirectory");
+    run(checkStreamReader, "checkStreamReader");
+    run(checkExtract, "checkExtract");
+    run(checkStaging, "checkStaging");
+    run(checkOwningAdd, "checkOwningAdd");
+    run(checkSnapshot, "checkSnapshot");
+    run(checkRewrite, "checkRewrite");
+    run(checkOverlay, "checkOverlay");
+    run(checkReadEntries, "checkReadEntries");
+    run(checkWriteToMemory, "checkWriteToMemory");
+    run(checkConcurrentAdds, "checkConcurrentAdds");
+    run(checkEncryption, "checkEncryption");
+    run(checkRemoteSource, "checkRemoteSource");
+    run(checkPrecompressed, "checkPrecompressed");
+    run(checkCompressionCache, "checkCompressionCache");
+    if (failures)
+    {
+      std::cout << failures << " checks failed\n";
+      return 1;
+    }
   }
   else
   {